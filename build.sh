@@ -0,0 +1,10 @@
+#!/bin/sh
+# Linux build, needs the SFML 2.6 and libcurl dev packages (e.g. apt install libsfml-dev libcurl4-openssl-dev)
+# Benchmarks:  ./bin/app --bench bench.json
+
+mkdir -p bin
+g++ -std=c++17 -O2 -o bin/app main.cpp -lsfml-graphics -lsfml-window -lsfml-system -lsfml-audio -lcurl -pthread || exit 1
+
+if [ "$1" != "--no-run" ]; then
+    ./bin/app
+fi
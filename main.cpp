@@ -1,3 +1,5 @@
+// curl pulls in windows.h, keep it from defining min() and max() macros
+#define NOMINMAX
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
 #include <curl/curl.h>
@@ -7,10 +9,32 @@
 #include <functional>
 #include <sstream>
 #include <time.h>
-#include <regex>
 #include <algorithm>
 #include <random>
 #include <filesystem>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <atomic>
+#include <future>
+#include <memory>
+#include <map>
+#include <string_view>
+#include <typeinfo>
+#include <typeindex>
+#include <cctype>
+#include <limits>
+#include <cstdio>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 
 // Callback function to write received data into a string
 size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* buffer) {
@@ -19,167 +43,523 @@ size_t WriteCallback(void* contents, size_t size, size_t nmemb, std::string* buf
     return total_size;
 }
 
-int extractStatusCode(const std::string& jsonString) {
-    std::regex statusCodePattern(R"("status":(\d+))");
-    std::smatch matches;
+struct HttpResponse {
+    CURLcode result = CURLE_OK;
+    long httpStatus = 0;    // 0 if the server never answered
+    std::string body;
+    std::map<std::string, std::string> headers;  // names in lower case
+    int attempts = 0;
+    std::chrono::steady_clock::duration elapsed{};  // from submit() to the answer, retries and their backoff included
+
+    std::string header(const std::string& name) const {
+        auto found = headers.find(name);
+        return found == headers.end() ? "" : found->second;
+    }
+};
+
+// gets a response body piece by piece while it downloads (on the HttpWorker thread), instead of HttpResponse::body
+class HttpBodySink {
+public:
+    virtual ~HttpBodySink() = default;
+    virtual void restart() = 0;     // a retry begins, forget what came so far
+    virtual void write(const char* data, size_t size) = 0;
+};
+
+/*
+Runs HTTP requests on its own thread so the window never waits for the network 📮
+submit() queues a request and returns right away, the future is ready once the request is done
+(poll it with wait_for(0) from the render loop). All transfers share one curl multi handle.
+Connection errors, 5xx and 429 are tried again up to MAX_ATTEMPTS times, waiting FIRST_BACKOFF, then twice as long.
+Destroying the worker aborts whatever is still running, those futures get CURLE_ABORTED_BY_CALLBACK.
+
+It lives as long as the game: libcurl is initialized once, and the multi handle keeps its connections (keep-alive)
+and DNS answers between requests, so a refresh or a second score doesn't pay for a new handshake. Easy handles and
+header lists are reused as well. Responses may come compressed, HTTPS servers may answer with HTTP/2 (one connection
+for all requests).
+*/
+class HttpWorker {
+public:
+    static const int MAX_ATTEMPTS = 3;
+    static constexpr std::chrono::milliseconds FIRST_BACKOFF{ 500 };
+
+    // maxConnections: how many idle connections stay open for reuse (the load test keeps one per client)
+    explicit HttpWorker(long maxConnections = 8) : multi(initMulti(maxConnections)), thread([this] { run(); }) {}
 
-    if (std::regex_search(jsonString, matches, statusCodePattern) && matches.size() > 1) {
-        // The status code is in the second capture group
-        return std::stoi(matches[1].str());
+    ~HttpWorker() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        curl_multi_wakeup(multi);
+        thread.join();
+        for (CURL* easy : idle)
+            curl_easy_cleanup(easy);
+        for (auto& entry : headerLists)
+            curl_slist_free_all(entry.second);
+        curl_multi_cleanup(multi);
     }
 
-    // Return a default value or handle the error as needed
-    return -1; // Indicates that the status code was not found
-}
+    // GET when postData is empty, otherwise POST; timeoutSeconds is per attempt
+    // with a sink the body goes there and HttpResponse::body stays empty, read the sink once the future is ready
+    std::future<HttpResponse> submit(const std::string& url, const std::string& postData = "", const std::vector<std::string>& headers = {},
+                                     long timeoutSeconds = 15, int maxAttempts = MAX_ATTEMPTS, std::shared_ptr<HttpBodySink> sink = nullptr) {
+        auto transfer = std::make_unique<Transfer>();
+        transfer->sink = std::move(sink);
+        transfer->url = url;
+        transfer->postData = postData;
+        transfer->timeoutSeconds = timeoutSeconds;
+        transfer->maxAttempts = maxAttempts;
+        transfer->headers = headers;
+        transfer->submittedAt = Clock::now();
+        std::future<HttpResponse> future = transfer->promise.get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            incoming.push_back(std::move(transfer));
+        }
+        curl_multi_wakeup(multi);
+        return future;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Transfer {
+        std::string url;
+        std::string postData;
+        std::vector<std::string> headers;
+        std::shared_ptr<HttpBodySink> sink;
+        long timeoutSeconds = 15;
+        int maxAttempts = MAX_ATTEMPTS;
+        CURL* easy = nullptr;
+        HttpResponse response;
+        std::promise<HttpResponse> promise;
+        Clock::time_point startAt;  // the backoff before a retry
+        Clock::time_point submittedAt;
+    };
+
+    CURLM* multi;
+    // only touched by the worker thread
+    std::vector<CURL*> idle;
+    std::map<std::vector<std::string>, curl_slist*> headerLists;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<Transfer>> incoming;
+    bool stopping = false;
+    std::thread thread;
+
+    static CURLM* initMulti(long maxConnections) {
+        // curl_global_init isn't thread safe, this runs before any transfer thread exists
+        static struct CurlGlobal {
+            CurlGlobal() { curl_global_init(CURL_GLOBAL_DEFAULT); }
+            ~CurlGlobal() { curl_global_cleanup(); }
+        } global;
+        CURLM* multi = curl_multi_init();
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, maxConnections);
+        return multi;
+    }
+
+    void run() {
+        std::vector<std::unique_ptr<Transfer>> waiting;
+        std::map<CURL*, std::unique_ptr<Transfer>> running;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping)
+                    break;
+                for (auto& transfer : incoming)
+                    waiting.push_back(std::move(transfer));
+                incoming.clear();
+            }
+
+            Clock::time_point now = Clock::now();
+            for (size_t i = 0; i < waiting.size();) {
+                if (waiting[i]->startAt <= now) {
+                    CURL* easy = start(*waiting[i]);
+                    running[easy] = std::move(waiting[i]);
+                    waiting.erase(waiting.begin() + i);
+                } else {
+                    i++;
+                }
+            }
+
+            int stillRunning = 0;
+            curl_multi_perform(multi, &stillRunning);
+            int queued = 0;
+            while (CURLMsg* message = curl_multi_info_read(multi, &queued)) {
+                if (message->msg != CURLMSG_DONE)
+                    continue;
+                auto found = running.find(message->easy_handle);
+                std::unique_ptr<Transfer> transfer = std::move(found->second);
+                running.erase(found);
+                if (finish(*transfer, message->data.result))
+                    waiting.push_back(std::move(transfer));
+            }
+
+            // sleeps until a socket has something, a retry is due or submit() wakes us up
+            Clock::time_point nextStart = Clock::now() + std::chrono::seconds(1);
+            for (auto& transfer : waiting)
+                nextStart = std::min(nextStart, transfer->startAt);
+            int timeout = (int)std::chrono::duration_cast<std::chrono::milliseconds>(nextStart - Clock::now()).count();
+            curl_multi_poll(multi, nullptr, 0, std::max(timeout, 0), nullptr);
+        }
+
+        for (auto& entry : running) {
+            curl_multi_remove_handle(multi, entry.first);
+            curl_easy_cleanup(entry.first);
+            abort(*entry.second);
+        }
+        for (auto& transfer : waiting)
+            abort(*transfer);
+        for (auto& transfer : incoming)
+            abort(*transfer);
+    }
+
+    CURL* start(Transfer& transfer) {
+        transfer.response.attempts++;
+        transfer.response.body.clear();
+        transfer.response.headers.clear();
+        if (transfer.sink != nullptr)
+            transfer.sink->restart();
+        if (idle.empty()) {
+            transfer.easy = curl_easy_init();
+        } else {
+            transfer.easy = idle.back();
+            idle.pop_back();
+            curl_easy_reset(transfer.easy);
+        }
+        curl_slist*& headers = headerLists[transfer.headers];
+        if (headers == nullptr) {
+            for (const std::string& header : transfer.headers)
+                headers = curl_slist_append(headers, header.c_str());
+        }
 
-// return false on unsuccessful request <3
-bool saveScore(std::string name, int score) {
-    CURL* curl;
-    CURLcode res;
-    std::string readBuffer;
-
-    // Initialize libcurl
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-    bool isRequestSuccessful;
-    if(curl) {
-        // Set the URL
-        curl_easy_setopt(curl, CURLOPT_URL, "http://marco.jaros.ch/score/create.php");
-        // Set the HTTP method to POST
-        curl_easy_setopt(curl, CURLOPT_POST, 1L);
-
-        // Set the headers to indicate JSON data
-        struct curl_slist* headers = NULL;
-        headers = curl_slist_append(headers, "Content-Type: application/json");
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-        // Set the POST data using std::format
-        std::ostringstream postDataStream;
-        postDataStream << R"({"name": ")" << name << R"(","score": ")" << score << "\"}";
-        std::string postData = postDataStream.str();
-        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postData.c_str());
-
-        // Set the write callback function
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-
-        // Perform the request
-        res = curl_easy_perform(curl);
-
-        // Check for errors
-        if(res != CURLE_OK) {
-            fprintf(stderr, "curl_easy_perform() failed: %s\n", curl_easy_strerror(res));
-            isRequestSuccessful = false;
+        curl_easy_setopt(transfer.easy, CURLOPT_URL, transfer.url.c_str());
+        if (!transfer.postData.empty()) {
+            curl_easy_setopt(transfer.easy, CURLOPT_POST, 1L);
+            curl_easy_setopt(transfer.easy, CURLOPT_POSTFIELDS, transfer.postData.c_str());
+        }
+        curl_easy_setopt(transfer.easy, CURLOPT_HTTPHEADER, headers);
+        curl_easy_setopt(transfer.easy, CURLOPT_HEADERFUNCTION, HeaderCallback);
+        curl_easy_setopt(transfer.easy, CURLOPT_HEADERDATA, &transfer.response);
+        curl_easy_setopt(transfer.easy, CURLOPT_ACCEPT_ENCODING, "");   // whatever this libcurl can decompress
+        curl_easy_setopt(transfer.easy, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(transfer.easy, CURLOPT_PIPEWAIT, 1L);         // rather wait for the HTTP/2 connection than open a second one
+        curl_easy_setopt(transfer.easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(transfer.easy, CURLOPT_DNS_CACHE_TIMEOUT, 600L);
+        if (transfer.sink != nullptr) {
+            curl_easy_setopt(transfer.easy, CURLOPT_WRITEFUNCTION, SinkCallback);
+            curl_easy_setopt(transfer.easy, CURLOPT_WRITEDATA, transfer.sink.get());
         } else {
-            std::cout << "Response: " << readBuffer << std::endl;
-            int statusCode = extractStatusCode(readBuffer);
-            isRequestSuccessful = statusCode == 201;
+            curl_easy_setopt(transfer.easy, CURLOPT_WRITEFUNCTION, WriteCallback);
+            curl_easy_setopt(transfer.easy, CURLOPT_WRITEDATA, &transfer.response.body);
+        }
+        curl_easy_setopt(transfer.easy, CURLOPT_CONNECTTIMEOUT, std::min(transfer.timeoutSeconds, 5L));
+        curl_easy_setopt(transfer.easy, CURLOPT_TIMEOUT, transfer.timeoutSeconds);
+        curl_easy_setopt(transfer.easy, CURLOPT_NOSIGNAL, 1L); // no SIGALRM for DNS timeouts, we are not the main thread
+        curl_multi_add_handle(multi, transfer.easy);
+        return transfer.easy;
+    }
+
+    // one "Name: value" line per call
+    static size_t HeaderCallback(char* line, size_t size, size_t nmemb, HttpResponse* response) {
+        std::string_view text(line, size * nmemb);
+        size_t colon = text.find(':');
+        if (colon != std::string_view::npos) {
+            std::string name(text.substr(0, colon));
+            for (char& c : name)
+                c = (char)std::tolower((unsigned char)c);
+            std::string_view value = text.substr(colon + 1);
+            while (!value.empty() && (value.front() == ' ' || value.front() == '\t'))
+                value.remove_prefix(1);
+            while (!value.empty() && (value.back() == '\r' || value.back() == '\n' || value.back() == ' '))
+                value.remove_suffix(1);
+            response->headers[name] = std::string(value);
+        }
+        return size * nmemb;
+    }
+
+    static size_t SinkCallback(void* contents, size_t size, size_t nmemb, HttpBodySink* sink) {
+        sink->write((const char*)contents, size * nmemb);
+        return size * nmemb;
+    }
+
+    // true if the transfer should go again after its backoff
+    bool finish(Transfer& transfer, CURLcode result) {
+        curl_multi_remove_handle(multi, transfer.easy);
+        transfer.response.result = result;
+        transfer.response.httpStatus = 0;
+        curl_easy_getinfo(transfer.easy, CURLINFO_RESPONSE_CODE, &transfer.response.httpStatus);
+        idle.push_back(transfer.easy);
+        transfer.easy = nullptr;
+
+        long status = transfer.response.httpStatus;
+        bool retry = result != CURLE_OK || status >= 500 || status == 429;
+        if (retry && transfer.response.attempts < transfer.maxAttempts) {
+            transfer.startAt = Clock::now() + FIRST_BACKOFF * (1 << (transfer.response.attempts - 1));
+            return true;
         }
+        transfer.response.elapsed = Clock::now() - transfer.submittedAt;
+        transfer.promise.set_value(std::move(transfer.response));
+        return false;
+    }
 
-        // Clean up
-        curl_easy_cleanup(curl);
-        curl_slist_free_all(headers);
+    void abort(Transfer& transfer) {
+        transfer.response.result = CURLE_ABORTED_BY_CALLBACK;
+        transfer.response.elapsed = Clock::now() - transfer.submittedAt;
+        transfer.promise.set_value(std::move(transfer.response));
     }
+};
 
-    curl_global_cleanup();
-    return isRequestSuccessful;
+// where create.php and read.php live; PTJ_SCORE_SERVER points the game at another one, e.g. a local test server
+std::string scoreServer() {
+    const char* custom = std::getenv("PTJ_SCORE_SERVER");
+    return custom != nullptr ? custom : "http://marco.jaros.ch/score/";
 }
 
-std::pair<std::string, int> getNameAndScoreByRank(const std::string& data, int rank) {
-    std::string name;
+std::string jsonEscape(const std::string& text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char)c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof escaped, "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+struct ScoreSubmission {
+    std::string key;    // idempotency key: create.php stores every key once, however often it is sent
+    std::string name;   // UTF-8
     int score = 0;
+};
 
-    // Find the "data" array
-    size_t pos = data.find("\"data\"");
-    if (pos == std::string::npos) {
-        std::cerr << "Data array not found in JSON" << std::endl;
-        return { name, score };
+// create.php takes a list of scores in one request, answers 201 once it has handled all of them
+std::string scoreBatchJson(const std::vector<ScoreSubmission>& batch) {
+    std::ostringstream json;
+    json << "[";
+    for (size_t i = 0; i < batch.size(); i++) {
+        json << (i > 0 ? "," : "") << R"({"key":")" << batch[i].key << R"(","name":")" << jsonEscape(batch[i].name)
+             << R"(","score":")" << batch[i].score << "\"}";
     }
+    json << "]";
+    return json.str();
+}
 
-    // Find the beginning of the array
-    pos = data.find('[', pos);
-    if (pos == std::string::npos) {
-        std::cerr << "Data array not found in JSON" << std::endl;
-        return { name, score };
-    }
+// the answer goes to sink, e.g. a ScoreListParser for the rank of each score
+std::future<HttpResponse> submitScores(HttpWorker& http, const std::vector<ScoreSubmission>& batch, long timeoutSeconds, int maxAttempts,
+                                       std::shared_ptr<HttpBodySink> sink = nullptr) {
+    return http.submit(scoreServer() + "create.php", scoreBatchJson(batch), { "Content-Type: application/json" }, timeoutSeconds, maxAttempts, sink);
+}
 
-    // Iterate through each object in the array
-    while (true) {
-        // Find the beginning of an object
-        pos = data.find('{', pos);
-        if (pos == std::string::npos)
-            break;
+struct ScoreRecord {
+    int rank = 0;
+    int score = 0;
+    std::string name;   // UTF-8
+    std::string key;    // only in create.php's answers: which submission this rank is for
+};
 
-        // Find the end of the object
-        size_t endPos = data.find('}', pos);
-        if (endPos == std::string::npos)
-            break;
+/*
+Reads read.php's answer {"status":200, "data":[{"name":"...","score":"12","rank":"1"}, ...]} in one pass 📜
+create.php's answer to a batch has the same shape, {"status":201, "data":[{"key":"...","rank":3}, ...]}.
+It is fed straight from the download (HttpBodySink) and keeps no copy of the text, every data object becomes a
+ScoreRecord as soon as its } arrives. Numbers may come as JSON numbers or as strings (mysqli gives strings).
+Anything else in the answer is skipped, broken JSON just ends the parse with what was complete so far.
+*/
+class ScoreListParser : public HttpBodySink {
+public:
+    int status = -1;
+    std::vector<ScoreRecord> records;
+    bool failed = false;
 
-        // Extract the object
-        std::string object = data.substr(pos, endPos - pos + 1);
-
-        // Find "rank"
-        size_t rankPos = object.find("\"rank\":\"" + std::to_string(rank) + "\"");
-        if (rankPos != std::string::npos) {
-            // Find "name"
-            size_t namePos = object.find("\"name\":\"");
-            if (namePos != std::string::npos) {
-                namePos += 8; // Length of "\"name\":\""
-                size_t nameEnd = object.find('"', namePos);
-                name = object.substr(namePos, nameEnd - namePos);
-            }
+    void restart() override {
+        *this = ScoreListParser();
+    }
 
-            // Find "score"
-            size_t scorePos = object.find("\"score\":\"");
-            if (scorePos != std::string::npos) {
-                scorePos += 9; // Length of "\"score\":\""
-                size_t scoreEnd = object.find('"', scorePos);
-                score = std::stoi(object.substr(scorePos, scoreEnd - scorePos));
+    void write(const char* data, size_t size) override {
+        const char* end = data + size;
+        for (const char* at = data; at < end && !failed; ) {
+            if (state == IN_STRING) {
+                // copy plain runs in one go, only quotes and escapes need a closer look
+                const char* run = at;
+                while (at < end && *at != '"' && *at != '\\')
+                    at++;
+                token.append(run, at - run);
+                if (at == end)
+                    break;
+                if (*at == '"') {
+                    at++;
+                    endValue(true);
+                } else {
+                    state = IN_ESCAPE;
+                    escape.clear();
+                    at++;
+                }
+            } else if (state == IN_ESCAPE) {
+                escape += *at++;
+                if (escape[0] != 'u' || escape.size() == 5) {
+                    unescape();
+                    state = IN_STRING;
+                }
+            } else if (state == IN_SCALAR) {
+                const char* run = at;
+                while (at < end && !isDelimiter(*at))
+                    at++;
+                token.append(run, at - run);
+                if (at < end)
+                    endValue(false);
+            } else {
+                structural(*at++);
             }
-
-            break; // Stop after finding the specified rank
         }
+    }
 
-        // Move to the next object
-        pos = endPos + 1;
+private:
+    enum State { BETWEEN, IN_STRING, IN_ESCAPE, IN_SCALAR };
+    enum Key : char { OTHER, STATUS, DATA, NAME, SCORE, RANK, KEY };  // only the keys we care about
+    State state = BETWEEN;
+    std::string stack;              // '{' and '[' of the containers we are in
+    std::vector<Key> keys;          // the key whose value comes next, per level
+    bool expectKey = false;         // in an object, between { or , and the next key
+    bool inRecord = false;          // directly in one of the objects of "data"
+    std::string token;
+    std::string escape;
+    ScoreRecord record;
+
+    static bool isDelimiter(char c) {
+        return c == ',' || c == '}' || c == ']' || c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ':';
     }
 
-    return { name, score };
-}
+    static Key keyOf(const std::string& name) {
+        if (name == "status") return STATUS;
+        if (name == "data") return DATA;
+        if (name == "name") return NAME;
+        if (name == "score") return SCORE;
+        if (name == "rank") return RANK;
+        if (name == "key") return KEY;
+        return OTHER;
+    }
 
-std::vector<sf::Text*> curlGetScores() {
-    //curl_global_init(CURL_GLOBAL_DEFAULT);
-    CURL* curl = curl_easy_init();
-    std::string readBuffer;
-    std::vector<sf::Text*> texts;
-    if (curl) {
-        CURLcode res;
-        curl_easy_setopt(curl, CURLOPT_URL, "http://marco.jaros.ch/score/read.php");
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-        res = curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        if (res == CURLE_OK) {
-            for (int i = 1; i < 30; i++)
-            {
-                auto result = getNameAndScoreByRank(readBuffer, i);
-
-                // yeah this does leak memory but whatever..
-                sf::Font* font = new sf::Font;
-                font->loadFromFile("res/arial.ttf");
-
-                sf::Text* text = new sf::Text();
-                text->setFont(*font);
-                text->setCharacterSize(15);
-                text->setString(std::to_string(i) + ". " + std::to_string(result.second) + "   " + result.first);
-                text->setPosition(250, 300 + i*14);
-                texts.push_back(text);
+    void structural(char c) {
+        switch (c) {
+        case '{':
+        case '[':
+            stack += c;
+            keys.push_back(OTHER);
+            expectKey = c == '{';
+            inRecord = stack.size() == 3 && keys[0] == DATA && stack == "{[{";
+            if (inRecord)
+                record = ScoreRecord();
+            break;
+        case '}':
+        case ']':
+            if (stack.empty() || stack.back() != (c == '}' ? '{' : '[')) {
+                failed = true;
+                break;
             }
+            if (inRecord)
+                records.push_back(std::move(record));
+            stack.pop_back();
+            keys.pop_back();
+            expectKey = false;
+            inRecord = false;
+            break;
+        case ',':
+            expectKey = !stack.empty() && stack.back() == '{';
+            break;
+        case '"':
+            token.clear();
+            state = IN_STRING;
+            return;
+        case ':':
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            break;
+        default:
+            token.assign(1, c);
+            state = IN_SCALAR;
+            return;
         }
+        state = BETWEEN;
     }
-    return texts;
-}
 
+    void endValue(bool quoted) {
+        state = BETWEEN;
+        if (stack.empty())
+            return;
+        if (quoted && expectKey) {
+            keys.back() = keyOf(token);
+            expectKey = false;
+            return;
+        }
+        Key key = keys.back();
+        if (inRecord) {
+            if (key == NAME)
+                record.name.swap(token);
+            else if (key == SCORE)
+                record.score = toInt();
+            else if (key == RANK)
+                record.rank = toInt();
+            else if (key == KEY)
+                record.key.swap(token);
+        } else if (key == STATUS && stack.size() == 1) {
+            status = toInt();
+        }
+    }
+
+    int toInt() const {
+        int value = 0;
+        bool negative = !token.empty() && token[0] == '-';
+        for (size_t i = negative ? 1 : 0; i < token.size() && std::isdigit((unsigned char)token[i]); i++)
+            value = value * 10 + (token[i] - '0');
+        return negative ? -value : value;
+    }
+
+    // escape holds what came after the backslash
+    void unescape() {
+        switch (escape[0]) {
+        case 'n': token += '\n'; return;
+        case 't': token += '\t'; return;
+        case 'r': token += '\r'; return;
+        case 'b': token += '\b'; return;
+        case 'f': token += '\f'; return;
+        case 'u': break;
+        default: token += escape[0]; return;    // \" \\ \/
+        }
+        unsigned code = (unsigned)std::strtoul(escape.c_str() + 1, nullptr, 16);
+        // json_encode splits characters above U+FFFF into two \u escapes, those end up as two '?'
+        if (code >= 0xD800 && code < 0xE000)
+            token += '?';
+        else if (code < 0x80)
+            token += (char)code;
+        else if (code < 0x800)
+            token += { (char)(0xC0 | code >> 6), (char)(0x80 | (code & 0x3F)) };
+        else
+            token += { (char)(0xE0 | code >> 12), (char)(0x80 | (code >> 6 & 0x3F)), (char)(0x80 | (code & 0x3F)) };
+    }
+};
+
+// one page of the board, best first; the scores end up in parser once the future is ready
+// with the validators of a cached page an unchanged page comes back as 304 without a body
+std::future<HttpResponse> fetchScores(HttpWorker& http, std::shared_ptr<ScoreListParser> parser, int offset, int limit,
+                                      const std::string& etag = "", const std::string& lastModified = "") {
+    std::vector<std::string> headers;
+    if (!etag.empty())
+        headers.push_back("If-None-Match: " + etag);
+    if (!lastModified.empty())
+        headers.push_back("If-Modified-Since: " + lastModified);
+    // short timeout and one retry: offline, the placeholders should give up while the player is still in the menu
+    std::string url = scoreServer() + "read.php?limit=" + std::to_string(limit) + "&offset=" + std::to_string(offset);
+    return http.submit(url, "", headers, 4L, 2, parser);
+}
 
 class Button {
 public:
@@ -242,6 +622,190 @@ private:
 };
 
 
+/*
+The menu's leaderboard: a window of visibleRows rows over a list that can be as long as the server's 📋
+Only the rows in view are drawn, all from one vertex array over the font's glyph texture, rebuilt when the top row
+changes. Scrolling (mouse wheel) eases towards its target and the view clips the half rows at the edges.
+Rows come in pages of PAGE_SIZE from read.php, fetched in the background when they get within PREFETCH_ROWS of the
+view; at most KEPT_PAGES stay in memory, the ones furthest away are dropped and fetched again when needed.
+Nothing is fetched before setPage(0, ...) (the cached or fresh top page) or after setOffline().
+*/
+class LeaderboardView {
+public:
+    static const int PAGE_SIZE = 50;
+    static const int PREFETCH_ROWS = 20;
+    static const int KEPT_PAGES = 6;
+    static const int CHARACTER_SIZE = 15;
+    static constexpr float ROW_HEIGHT = 14.f;
+
+    LeaderboardView(sf::Vector2f position, float width, int visibleRows, const sf::Font& font, HttpWorker& http)
+        : position(position), width(width), visibleRows(visibleRows), font(font), http(http), vertices(sf::Triangles) {}
+
+    void setPage(int page, std::vector<ScoreRecord> records) {
+        if ((int)records.size() < PAGE_SIZE)
+            endRow = page * PAGE_SIZE + (int)records.size();
+        else if (endRow >= 0 && endRow <= (page + 1) * PAGE_SIZE)
+            endRow = -1;    // the board grew
+        pages[page] = std::move(records);
+        started = true;
+        offline = false;
+        dirty = true;
+
+        // keep the pages closest to the view
+        int viewPage = (int)scroll / PAGE_SIZE;
+        while ((int)pages.size() > KEPT_PAGES) {
+            auto furthest = std::max_element(pages.begin(), pages.end(), [viewPage](const auto& a, const auto& b) {
+                return std::abs(a.first - viewPage) < std::abs(b.first - viewPage);
+            });
+            pages.erase(furthest);
+        }
+    }
+
+    // no board and no connection, shown instead of empty rows
+    void setOffline() {
+        if (pages.empty())
+            offline = true;
+        dirty = true;
+    }
+
+    void handleEvent(const sf::Event& event, const sf::RenderWindow& window) {
+        if (event.type != sf::Event::MouseWheelScrolled)
+            return;
+        sf::Vector2f mouse = window.mapPixelToCoords(sf::Vector2i(event.mouseWheelScroll.x, event.mouseWheelScroll.y));
+        if (sf::FloatRect(position, sf::Vector2f(width, visibleRows * ROW_HEIGHT)).contains(mouse))
+            targetScroll = std::clamp(targetScroll - event.mouseWheelScroll.delta * 3.f, 0.f, (float)maxScroll());
+    }
+
+    // every frame: scrolling, finished pages, the next page to fetch
+    void update() {
+        float step = (targetScroll - scroll) * 0.25f;
+        scroll = std::abs(step) < 0.01f ? targetScroll : scroll + step;
+
+        if (request.valid() && request.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            HttpResponse response = request.get();
+            if (response.result == CURLE_OK && parser->status == 200)
+                setPage(requestedPage, std::move(parser->records));
+            else
+                retryAt = std::chrono::steady_clock::now() + std::chrono::seconds(3);
+        }
+        if (!started || offline || request.valid() || std::chrono::steady_clock::now() < retryAt)
+            return;
+        int first = std::max(0, (int)scroll - PREFETCH_ROWS);
+        int last = (int)scroll + visibleRows + PREFETCH_ROWS;
+        if (endRow >= 0)
+            last = std::min(last, endRow - 1);
+        for (int page = first / PAGE_SIZE; page <= last / PAGE_SIZE && first <= last; page++) {
+            if (pages.count(page) == 0) {
+                requestedPage = page;
+                parser = std::make_shared<ScoreListParser>();
+                request = fetchScores(http, parser, page * PAGE_SIZE, PAGE_SIZE);
+                break;
+            }
+        }
+    }
+
+    void draw(sf::RenderWindow& window) {
+        int top = (int)scroll;
+        if (dirty || top != builtTop)
+            build(top);
+
+        // clip to the widget, scrolled by the part of a row that is above it
+        sf::View previous = window.getView();
+        sf::Vector2f size(width, visibleRows * ROW_HEIGHT);
+        sf::View clip(sf::FloatRect(position.x, position.y + (scroll - top) * ROW_HEIGHT, size.x, size.y));
+        // the widget's rect in the current view, as a part of that view's viewport (the window may have been resized)
+        sf::Vector2f viewSize = previous.getSize();
+        sf::Vector2f viewCorner = previous.getCenter() - viewSize / 2.f;
+        sf::FloatRect viewport = previous.getViewport();
+        clip.setViewport(sf::FloatRect(viewport.left + (position.x - viewCorner.x) / viewSize.x * viewport.width,
+                                       viewport.top + (position.y - viewCorner.y) / viewSize.y * viewport.height,
+                                       size.x / viewSize.x * viewport.width, size.y / viewSize.y * viewport.height));
+        window.setView(clip);
+        window.draw(vertices, &font.getTexture(CHARACTER_SIZE));
+        window.setView(previous);
+    }
+
+private:
+    sf::Vector2f position;
+    float width;
+    int visibleRows;
+    const sf::Font& font;
+    HttpWorker& http;
+
+    std::map<int, std::vector<ScoreRecord>> pages;
+    int endRow = -1;            // rows on the board, -1 until a short page shows where it ends
+    bool started = false;
+    bool offline = false;
+    float scroll = 0.f;         // in rows
+    float targetScroll = 0.f;
+
+    std::future<HttpResponse> request;
+    std::shared_ptr<ScoreListParser> parser;
+    int requestedPage = 0;
+    std::chrono::steady_clock::time_point retryAt;
+
+    sf::VertexArray vertices;
+    int builtTop = -1;
+    bool dirty = true;
+
+    int maxScroll() const {
+        // until the end is known, as far as pages have been loaded, further pages come as the view gets close
+        int rows = endRow >= 0 ? endRow : (pages.empty() ? 0 : (pages.rbegin()->first + 1) * PAGE_SIZE);
+        return std::max(0, rows - visibleRows);
+    }
+
+    const ScoreRecord* row(int index) const {
+        auto page = pages.find(index / PAGE_SIZE);
+        if (page == pages.end() || index % PAGE_SIZE >= (int)page->second.size())
+            return nullptr;
+        return &page->second[index % PAGE_SIZE];
+    }
+
+    void build(int top) {
+        vertices.clear();
+        for (int i = 0; i <= visibleRows; i++) {
+            int index = top + i;
+            if (endRow >= 0 && index >= endRow)
+                break;
+            sf::Vector2f at(position.x, position.y + i * ROW_HEIGHT);
+            const ScoreRecord* record = row(index);
+            if (offline)
+                addLine(i == 0 ? "leaderboard offline" : "", at, sf::Color::White);
+            else if (record == nullptr)
+                addLine(std::to_string(index + 1) + ". ...", at, sf::Color(160, 160, 160));
+            else
+                addLine(std::to_string(record->rank) + ". " + std::to_string(record->score) + "   "
+                        + sf::String::fromUtf8(record->name.begin(), record->name.end()), at, sf::Color::White);
+        }
+        builtTop = top;
+        dirty = false;
+    }
+
+    // two triangles per glyph, laid out like sf::Text does it
+    void addLine(const sf::String& text, sf::Vector2f at, sf::Color color) {
+        float x = at.x;
+        float baseline = at.y + CHARACTER_SIZE;
+        sf::Uint32 previous = 0;
+        for (sf::Uint32 codePoint : text) {
+            x += font.getKerning(previous, codePoint, CHARACTER_SIZE);
+            previous = codePoint;
+            const sf::Glyph& glyph = font.getGlyph(codePoint, CHARACTER_SIZE, false);
+            float left = x + glyph.bounds.left, right = left + glyph.bounds.width;
+            float top = baseline + glyph.bounds.top, bottom = top + glyph.bounds.height;
+            float u1 = (float)glyph.textureRect.left, u2 = u1 + glyph.textureRect.width;
+            float v1 = (float)glyph.textureRect.top, v2 = v1 + glyph.textureRect.height;
+            vertices.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+            vertices.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+            vertices.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+            x += glyph.advance;
+        }
+    }
+};
+
+
 struct GridPos {
     int x;
     int y;
@@ -252,111 +816,1865 @@ struct GridPos {
         return this->x == gridPos.x && this->y == gridPos.y;
     }
 
-    bool sameYBiggerX (GridPos gridPos) {
-        return this->x <= gridPos.x && this->y == gridPos.y;
-    }
+    bool sameYBiggerX (GridPos gridPos) {
+        return this->x <= gridPos.x && this->y == gridPos.y;
+    }
+};
+
+
+// ---------------------------- TIMERS ------------------------------
+
+class Entity;
+
+struct TimerHandle {
+    int index = -1;
+    uint32_t generation = 0;
+};
+
+/*
+Hierarchical timer wheel: lots of "call this at tick T" timers for little work per tick ⏰
+4 levels of 64 slots. Level 0 holds the timers due within the current block of 64 ticks, level 1 the ones due
+later in the current block of 4096 ticks, and so on. Whenever the wheel enters a new block, that block's timers
+move down a level. A tick costs the timers that fire (and every timer moves down at most 3 times),
+no matter how many are waiting. Timers further out than 64^4 ticks (~3 days at 60 fps) are clamped to that.
+
+    TimerHandle schedule(int64_t due, Entity* owner, std::function<void()> callback)
+    void cancel(TimerHandle handle)
+    void advance(std::vector<Fired>& fired)   hands out the timers due at now(), then moves to the next tick
+
+Entities use it through Game::schedule().
+*/
+class TimerWheel {
+public:
+    struct Fired {
+        Entity* owner;
+        TimerHandle handle;
+        std::function<void()> callback;
+    };
+
+    // the tick advance() works on next
+    int64_t now() const {
+        return current;
+    }
+
+    TimerHandle schedule(int64_t due, Entity* owner, std::function<void()> callback) {
+        int index;
+        if (freeNodes.empty()) {
+            index = (int)nodes.size();
+            nodes.emplace_back();
+        } else {
+            index = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        Node& node = nodes[index];
+        node.due = std::min(std::max(due, current), current + RANGE - 1);
+        node.owner = owner;
+        node.callback = std::move(callback);
+        insert(index);
+        return { index, node.generation };
+    }
+
+    // the node is reused right away, its old slot entry gets skipped when the wheel comes by
+    void cancel(TimerHandle handle) {
+        if (handle.index < 0 || handle.index >= (int)nodes.size())
+            return;
+        if (nodes[handle.index].generation == handle.generation)
+            release(handle.index);
+    }
+
+    // timers due at the same tick come out in the order they were scheduled
+    void advance(std::vector<Fired>& fired) {
+        // blocks that start now move down a level, the biggest first so nothing skips a level
+        int topLevel = 0;
+        while (topLevel + 1 < LEVELS && (current & ((int64_t(1) << (BITS * (topLevel + 1))) - 1)) == 0)
+            topLevel++;
+        for (int level = topLevel; level >= 1; level--) {
+            cascading.swap(slots[level][(current >> (BITS * level)) & MASK]);
+            for (TimerHandle entry : cascading) {
+                if (nodes[entry.index].generation == entry.generation)
+                    insert(entry.index);
+            }
+            cascading.clear();
+        }
+
+        firing.swap(slots[0][current & MASK]);
+        for (TimerHandle entry : firing) {
+            Node& node = nodes[entry.index];
+            if (node.generation != entry.generation)
+                continue;
+            fired.push_back({ node.owner, entry, std::move(node.callback) });
+            release(entry.index);
+        }
+        firing.clear();
+        current++;
+    }
+
+private:
+    static const int BITS = 6;
+    static const int LEVELS = 4;
+    static const int MASK = (1 << BITS) - 1;
+    static const int64_t RANGE = int64_t(1) << (BITS * LEVELS);
+
+    struct Node {
+        int64_t due = 0;
+        Entity* owner = nullptr;
+        std::function<void()> callback;
+        uint32_t generation = 0;    // bumped on release, old handles and slot entries stop matching
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> freeNodes;
+    std::vector<TimerHandle> slots[LEVELS][1 << BITS];  // vectors keep their memory between rounds
+    std::vector<TimerHandle> cascading;
+    std::vector<TimerHandle> firing;
+    int64_t current = 0;
+
+    // lowest level whose current block also contains the due tick
+    void insert(int index) {
+        int64_t due = nodes[index].due;
+        int level = 0;
+        while (level + 1 < LEVELS && (due >> (BITS * (level + 1))) != (current >> (BITS * (level + 1))))
+            level++;
+        slots[level][(due >> (BITS * level)) & MASK].push_back({ index, nodes[index].generation });
+    }
+
+    void release(int index) {
+        Node& node = nodes[index];
+        node.callback = nullptr;
+        node.owner = nullptr;
+        node.generation++;
+        freeNodes.push_back(index);
+    }
+};
+
+
+// ---------------------------- ARCHETYPES ------------------------------
+
+// Every entity class that can be spawned (and saved, the autosave stores these numbers)
+enum EntityKind {
+    KIND_ZOMBIE, KIND_TANK_ZOMBIE, KIND_CHAINSAW_ZOMBIE, KIND_BULLDOZER,
+    KIND_STONE, KIND_ROCK,
+    KIND_PLANT, KIND_PRODUCTION_PLANT, KIND_TANK_PLANT, KIND_MENDING_PLANT, KIND_TREE, KIND_BOMB, KIND_HEAVY_PLANT,
+    ENTITY_KIND_COUNT
+};
+
+// Which pixels of a frame are solid: bit x % 64 of rows[y * stride + x / 64], stride words per row
+struct AlphaMask {
+    int width = 0;
+    int height = 0;
+    int stride = 1;
+    int firstRow = 0;       // rows outside firstRow .. lastRow are empty
+    int lastRow = -1;
+    std::vector<uint64_t> rows;
+
+    void build(const sf::Image& image) {
+        width = image.getSize().x;
+        height = image.getSize().y;
+        stride = std::max(1, (width + 63) / 64);
+        rows.assign((size_t)height * stride, 0);
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                if (image.getPixel(x, y).a >= 128)
+                    rows[y * stride + x / 64] |= uint64_t(1) << (x % 64);
+            }
+        }
+        auto empty = [this](int y) { return std::all_of(&rows[y * stride], &rows[y * stride] + stride, [](uint64_t word) { return word == 0; }); };
+        firstRow = 0;
+        while (firstRow < height && empty(firstRow))
+            firstRow++;
+        lastRow = height - 1;
+        while (lastRow >= firstRow && empty(lastRow))
+            lastRow--;
+    }
+
+    // other's top left pixel sits at (dx, dy) in this one
+    bool overlaps(const AlphaMask& other, int dx, int dy) const {
+        if (dx <= -other.width || dx >= width)
+            return false;
+        int from = std::max(firstRow, other.firstRow + dy);
+        int to = std::min(lastRow, other.lastRow + dy);
+        const uint64_t* mine = rows.data();
+        const uint64_t* theirs = other.rows.data();
+        uint64_t hit = 0;
+        // the 32 px sprites: one word per row, a shift and an AND each and no branch inside the loop
+        // (plain code, whether it gets vectorized is up to the compiler)
+        if (stride == 1 && other.stride == 1) {
+            if (dx >= 0) {
+                for (int y = from; y <= to; y++)
+                    hit |= mine[y] & (theirs[y - dy] << dx);
+            } else {
+                for (int y = from; y <= to; y++)
+                    hit |= mine[y] & (theirs[y - dy] >> -dx);
+            }
+            return hit != 0;
+        }
+        // wider frames (the bomb): every word of this row against the 64 bits of the other row that land on it
+        for (int y = from; y <= to && hit == 0; y++) {
+            const uint64_t* row = mine + (size_t)y * stride;
+            const uint64_t* otherRow = theirs + (size_t)(y - dy) * other.stride;
+            for (int word = 0; word < stride; word++)
+                hit |= row[word] & bitsAt(otherRow, other.stride, word * 64 - dx);
+        }
+        return hit != 0;
+    }
+
+    // bits first .. first + 63 of a row, zero outside of it
+    static uint64_t bitsAt(const uint64_t* row, int words, int first) {
+        int word = first >= 0 ? first / 64 : -((-first + 63) / 64);
+        int shift = first - word * 64;
+        auto at = [row, words](int i) { return i >= 0 && i < words ? row[i] : uint64_t(0); };
+        if (shift == 0)
+            return at(word);
+        return (at(word) >> shift) | (at(word + 1) << (64 - shift));
+    }
+};
+
+// How the frames of an entity kind change (see Entity::animationFrame())
+enum AnimationClip {
+    CLIP_LOOP,      // loops on the game clock, every entity of the kind shows the same frame; pauseAnimation holds it
+    CLIP_STILL,     // only when the entity picks a frame itself (showTexture()), e.g. by its health
+    CLIP_TIMED      // a timer per entity steps nextAnimationFrame(), for animations that do something (the bomb)
+};
+
+/*
+What all entities of one kind have in common, one shared record per kind instead of a copy in every entity 🧬
+The table (ARCHETYPES) is below the entity classes. Entities point to theirs, Entity::ready() stamps the values
+that can change while playing (health, animation) into the entity.
+Frames, their alpha masks and textures are looked up once per kind by prewarm() (Game does it for all kinds when
+it starts), so spawning doesn't touch the disk.
+*/
+struct Archetype {
+    const char* resDir;
+    const char* group;
+    const char* type;
+    Entity* (*make)(GridPos gridPos);   // for Game::createEntity(); zombies use the row, projectiles and plants the cell
+    float topHealth;
+    float speed;            // zombies walk with it (negative: to the left), projectiles are thrown with it
+    float damage;           // zombies per second, projectiles per hit
+    float frameDuration;
+    bool pauseAnimation;
+    AnimationClip clip;
+    sf::Vector2f origin;    // relative to the texture size
+
+    // filled once by prewarm()
+    mutable int frameCount = 1;
+    mutable std::vector<sf::Texture> textures{};
+    mutable std::vector<AlphaMask> masks{};     // per frame, headless games too
+    mutable std::once_flag framesCounted{};
+    mutable std::once_flag texturesLoaded{};
+
+    std::string framePath(int frame) const {
+        return "res/" + std::string(resDir) + "/" + std::to_string(frame) + ".png";
+    }
+
+    // nullptr for frames without an image
+    const AlphaMask* mask(int frame) const {
+        if (frame < 0 || frame >= (int)masks.size() || masks[frame].width == 0)
+            return nullptr;
+        return &masks[frame];
+    }
+
+    // headless games read the frames for their masks but never load textures; safe to call from several games at once
+    void prewarm(bool withTextures) const {
+        std::call_once(framesCounted, [this] {
+            sf::Image image;
+            while (std::filesystem::exists(framePath(masks.size()))) {
+                masks.emplace_back();
+                if (image.loadFromFile(framePath(masks.size() - 1)))
+                    masks.back().build(image);
+            }
+            frameCount = std::max((int)masks.size(), 1);
+        });
+        if (!withTextures)
+            return;
+        std::call_once(texturesLoaded, [this] {
+            // sprites keep pointers into this, it's never touched again
+            for (int frame = 0; frame < frameCount && std::filesystem::exists(framePath(frame)); frame++) {
+                textures.emplace_back();
+                textures.back().loadFromFile(framePath(frame));
+            }
+        });
+    }
+};
+
+extern const Archetype ARCHETYPES[ENTITY_KIND_COUNT];
+
+
+// Every other game object (Entity) must inherit from this class 🏛️
+// It provides basic game object functionalities that are used a lot
+// ... add functionality that all entities use here
+class Entity {
+public:
+    float x = 0;
+    float y = 0;
+    float xVel = 0;
+    float yVel = 0;
+    float health = 100;
+    float topHealth = 100;
+    int id = -1;
+    const Archetype* archetype;     // never null, what it is (see ARCHETYPES)
+    std::string_view group = "entity";
+    std::string_view type = "entity";
+    int lane = -1;              // board row it stays in and ticks with (see Game::tickLanes()), -1: moves between rows
+    bool destroyed = false;
+    bool needsTick = true;      // false: everything it does runs on timers (Game::schedule()), tick() isn't called
+    std::vector<TimerHandle> timers;    // pending, cancelled when it gets buried
+
+    // animation, the frames and the clip belong to the archetype
+    bool pauseAnimation = false;
+    sf::Sprite sprite;
+    int currentFrame = 0;
+    int shownTexture = -1;      // what the sprite has, setTexture() only when that changes
+    float frameDuration = 0.2f;
+    
+    class Game* game = nullptr;
+
+    static constexpr int SCALE = 100 / 32;   // texture pixels to screen pixels
+
+    Entity(const Archetype& archetype) : archetype(&archetype) {}
+    virtual ~Entity() {}
+
+    // use ready() instead of the constructor since class Game* game; isn't defined there yet
+    virtual void ready();
+
+    // CLIP_TIMED only: called every frameDuration by the timer ready() starts
+    virtual void nextAnimationFrame() {
+        if (pauseAnimation)
+            return;
+        currentFrame = (currentFrame + 1) % archetype->frameCount;
+        showTexture(currentFrame);
+    }
+
+    // after damage() or healing
+    virtual void onHealthChanged() {}
+
+    // after Game::restore() put it back where it was
+    virtual void onRestored() {}
+
+    // headless games (see Game::headless) never load textures, so always switch through here
+    void showTexture(int index) {
+        currentFrame = index;
+        if (index == shownTexture || index >= (int)archetype->textures.size())
+            return;
+        shownTexture = index;
+        sprite.setTexture(archetype->textures[index]);
+    }
+
+    // defined below Game class because they use Game class functions
+    int animationFrame() const;
+    bool touches(sf::Vector2f at, const Entity& other, sf::Vector2f otherAt) const;
+    virtual bool damage(float d);
+    virtual void tick();
+    virtual void draw();
+    void animate();
+    GridPos getGridPos();
+    void setGridPos(GridPos gridPos);
+};
+
+
+// ---------------------------- AUTOSAVE ------------------------------
+
+int entityKind(const Entity* entity) {
+    return (int)(entity->archetype - ARCHETYPES);
+}
+
+// Plain copy of one entity, cheap enough to take on the game thread
+struct EntityRecord {
+    uint8_t kind;
+    float x, y;
+    float xVel, yVel;
+    float health, topHealth;
+};
+
+// Everything needed to continue a game; filled at a tick boundary by Game::captureSnapshot()
+struct GameSnapshot {
+    int bananaCount = 0;
+    int score = 0;
+    int waveCount = 0;
+    int zombieChance = 0;
+    int passedWaves = 0;
+    std::vector<EntityRecord> entities;
+};
+
+// --- shared by the files we keep (autosave, leaderboard cache, score journal): varints, strings, FNV-1a checksum, atomic replace
+
+void putVarint(std::string& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((char)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((char)v);
+}
+
+void putSigned(std::string& out, int32_t v) {
+    putVarint(out, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+bool getVarint(const std::string& in, size_t& pos, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35 && pos < in.size(); shift += 7) {
+        uint8_t byte = in[pos++];
+        v |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+bool getSigned(const std::string& in, size_t& pos, int32_t& v) {
+    uint32_t raw;
+    if (!getVarint(in, pos, raw))
+        return false;
+    v = (int32_t)((raw >> 1) ^ (~(raw & 1) + 1));
+    return true;
+}
+
+// a varint length, then the bytes
+void putString(std::string& out, const std::string& text) {
+    putVarint(out, text.size());
+    out += text;
+}
+
+bool getString(const std::string& in, size_t& pos, std::string& text) {
+    uint32_t size;
+    if (!getVarint(in, pos, size) || size > in.size() - pos)
+        return false;
+    text = in.substr(pos, size);
+    pos += size;
+    return true;
+}
+
+uint32_t checksum(const std::string& data, size_t end) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < end; i++)
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    return hash;
+}
+
+void appendChecksum(std::string& data) {
+    uint32_t sum = checksum(data, data.size());
+    for (int i = 0; i < 4; i++)
+        data.push_back((char)(sum >> (i * 8)));
+}
+
+// true if the last 4 bytes are the checksum of the rest, which is left in body
+bool stripChecksum(const std::string& in, std::string& body) {
+    if (in.size() < 4)
+        return false;
+    size_t end = in.size() - 4;
+    uint32_t sum = 0;
+    for (int i = 0; i < 4; i++)
+        sum |= (uint32_t)(uint8_t)in[end + i] << (i * 8);
+    if (sum != checksum(in, end))
+        return false;
+    body = in.substr(0, end);
+    return true;
+}
+
+bool readFile(const std::string& path, std::string& data) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    data.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return true;
+}
+
+// appends and waits until it is on the disk, not just in some cache
+bool appendDurably(const std::string& path, const std::string& data) {
+    FILE* file = fopen(path.c_str(), "ab");
+    if (file == nullptr)
+        return false;
+    bool ok = fwrite(data.data(), 1, data.size(), file) == data.size() && fflush(file) == 0;
+#ifdef _WIN32
+    ok = ok && _commit(_fileno(file)) == 0;
+#else
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    return fclose(file) == 0 && ok;
+}
+
+// write next to the old file and swap it in, so a crash mid-write never leaves a broken file
+void writeFileAtomically(const std::string& path, const std::string& data) {
+    std::string tmpPath = path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(data.data(), data.size());
+        file.flush();
+        if (!file) {
+            std::cerr << "Could not write " << tmpPath << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        // some platforms refuse to rename onto an existing file
+        std::filesystem::remove(path, error);
+        std::filesystem::rename(tmpPath, path, error);
+    }
+    if (error)
+        std::cerr << "Could not replace " << path << ": " << error.message() << std::endl;
+}
+
+/*
+Writes snapshots to disk on its own thread so the frame never waits for the file system 💾
+There are two snapshot buffers: while the writer thread serializes one, the game can fill the other.
+If both are busy the game simply skips that autosave and tries again next tick.
+
+    GameSnapshot* acquire()   free buffer to fill, nullptr if the writer is busy
+    void publish()            hand the filled buffer to the writer thread
+    bool load(GameSnapshot&)  read the last save (game thread, at startup)
+    void discard()            forget the save, e.g. after game over
+*/
+class Autosave {
+public:
+    // at 60 ticks per second
+    int interval = 600;
+    float lastCaptureMicros = 0.f;
+    float maxCaptureMicros = 0.f;
+
+    Autosave(const std::string& path) : path(path) {
+        writer = std::thread([this] { run(); });
+    }
+
+    ~Autosave() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        writer.join();
+    }
+
+    GameSnapshot* acquire() {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock())
+            return nullptr;
+        for (int i = 0; i < 2; i++) {
+            if (i != writing && i != pending) {
+                filling = i;
+                return &buffers[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void publish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = filling;
+            discarded = false;
+        }
+        wake.notify_one();
+    }
+
+    // keeps an eye on what capturing costs the frame; we want to stay below 100 µs
+    void recordCaptureTime(float micros) {
+        lastCaptureMicros = micros;
+        maxCaptureMicros = std::max(maxCaptureMicros, micros);
+        if (micros > 100.f)
+            std::cerr << "Autosave capture took " << micros << " us" << std::endl;
+    }
+
+    void discard() {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = -1;
+        discarded = true;
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+    }
+
+    bool load(GameSnapshot& snapshot) {
+        std::string data;
+        return readFile(path, data) && decode(data, snapshot);
+    }
+
+private:
+    std::string path;
+    GameSnapshot buffers[2];
+    int filling = -1;
+    int pending = -1;
+    int writing = -1;
+    bool stopping = false;
+    bool discarded = false;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread writer;
+
+    static const uint32_t MAGIC = 0x4a545031; // "PTJ1"
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this] { return pending != -1 || stopping; });
+            // a save requested right before closing still gets written
+            if (pending == -1)
+                return;
+            writing = pending;
+            pending = -1;
+            lock.unlock();
+
+            writeFileAtomically(path, encode(buffers[writing]));
+
+            lock.lock();
+            writing = -1;
+            if (discarded) {
+                std::error_code ignored;
+                std::filesystem::remove(path, ignored);
+            }
+        }
+    }
+
+    // --- compact encoding: varints, positions in 1/16 px, velocities delta coded against the previous entity
+
+    static int32_t quantize(float f) { return (int32_t)std::lround(f * 16.f); }
+    static float dequantize(int32_t q) { return q / 16.f; }
+
+    static std::string encode(const GameSnapshot& snapshot) {
+        std::string out;
+        out.reserve(32 + snapshot.entities.size() * 12);
+        putVarint(out, MAGIC);
+        putSigned(out, snapshot.bananaCount);
+        putSigned(out, snapshot.score);
+        putSigned(out, snapshot.waveCount);
+        putSigned(out, snapshot.zombieChance);
+        putSigned(out, snapshot.passedWaves);
+        putVarint(out, snapshot.entities.size());
+
+        int32_t previous[6] = {};
+        for (const EntityRecord& record : snapshot.entities) {
+            out.push_back((char)record.kind);
+            int32_t values[6] = { quantize(record.x), quantize(record.y), quantize(record.xVel),
+                                  quantize(record.yVel), quantize(record.health), quantize(record.topHealth) };
+            for (int i = 0; i < 6; i++) {
+                putSigned(out, values[i] - previous[i]);
+                previous[i] = values[i];
+            }
+        }
+
+        appendChecksum(out);
+        return out;
+    }
+
+    static bool decode(const std::string& in, GameSnapshot& snapshot) {
+        std::string body;
+        if (!stripChecksum(in, body))
+            return false;
+        size_t pos = 0;
+        uint32_t magic, count;
+        int32_t header[5];
+        if (!getVarint(body, pos, magic) || magic != MAGIC)
+            return false;
+        for (int32_t& value : header) {
+            if (!getSigned(body, pos, value))
+                return false;
+        }
+        if (!getVarint(body, pos, count))
+            return false;
+
+        snapshot.bananaCount = header[0];
+        snapshot.score = header[1];
+        snapshot.waveCount = header[2];
+        snapshot.zombieChance = header[3];
+        snapshot.passedWaves = header[4];
+        snapshot.entities.clear();
+
+        int32_t previous[6] = {};
+        for (uint32_t n = 0; n < count; n++) {
+            if (pos >= body.size())
+                return false;
+            EntityRecord record;
+            record.kind = body[pos++];
+            if (record.kind >= ENTITY_KIND_COUNT)
+                return false;
+            for (int i = 0; i < 6; i++) {
+                int32_t delta;
+                if (!getSigned(body, pos, delta))
+                    return false;
+                previous[i] += delta;
+            }
+            record.x = dequantize(previous[0]);
+            record.y = dequantize(previous[1]);
+            record.xVel = dequantize(previous[2]);
+            record.yVel = dequantize(previous[3]);
+            record.health = dequantize(previous[4]);
+            record.topHealth = dequantize(previous[5]);
+            snapshot.entities.push_back(record);
+        }
+        return true;
+    }
+};
+
+
+/*
+The top page of the leaderboard (LeaderboardView::PAGE_SIZE rows) as read.php sent it last time, so the menu can
+show it before the network answers 🏆
+fetchScores() sends etag and lastModified along, an unchanged board then costs a 304 and no download.
+store() saves on a thread of its own; the file is varints like the autosave: ranks and scores delta coded (best first),
+names as length + UTF-8.
+*/
+class LeaderboardCache {
+public:
+    std::string etag;
+    std::string lastModified;
+    std::vector<ScoreRecord> records;   // best first
+
+    LeaderboardCache(const std::string& path) : path(path) {}
+
+    ~LeaderboardCache() {
+        if (writing.valid())
+            writing.wait();
+    }
+
+    bool load() {
+        std::string data;
+        return readFile(path, data) && decode(data);
+    }
+
+    // a fresh board from read.php (200), response has its validators
+    void store(const HttpResponse& response, std::vector<ScoreRecord> fresh) {
+        etag = response.header("etag");
+        lastModified = response.header("last-modified");
+        records = std::move(fresh);
+        std::stable_sort(records.begin(), records.end(), [](const ScoreRecord& a, const ScoreRecord& b) { return a.score > b.score; });
+
+        if (writing.valid())
+            writing.wait();
+        writing = std::async(std::launch::async, [path = path, data = encode()] { writeFileAtomically(path, data); });
+    }
+
+    // the rank score would get on the cached board: 1 + the scores above it, ties share a rank like RANK() on the server
+    int provisionalRank(int score) const {
+        auto firstNotAbove = std::partition_point(records.begin(), records.end(), [score](const ScoreRecord& record) { return record.score > score; });
+        return (int)(firstNotAbove - records.begin()) + 1;
+    }
+
+private:
+    std::string path;
+    std::future<void> writing;
+
+    static const uint32_t MAGIC = 0x4a54504c; // "PTJL"
+
+    std::string encode() const {
+        std::string out;
+        out.reserve(32 + records.size() * 16);
+        putVarint(out, MAGIC);
+        putString(out, etag);
+        putString(out, lastModified);
+        putVarint(out, records.size());
+        ScoreRecord previous;
+        for (const ScoreRecord& record : records) {
+            putSigned(out, record.rank - previous.rank);
+            putSigned(out, record.score - previous.score);
+            putString(out, record.name);
+            previous = record;
+        }
+        appendChecksum(out);
+        return out;
+    }
+
+    bool decode(const std::string& in) {
+        std::string body;
+        size_t pos = 0;
+        uint32_t magic, count;
+        if (!stripChecksum(in, body) || !getVarint(body, pos, magic) || magic != MAGIC)
+            return false;
+        std::string readEtag, readLastModified;
+        if (!getString(body, pos, readEtag) || !getString(body, pos, readLastModified) || !getVarint(body, pos, count))
+            return false;
+
+        std::vector<ScoreRecord> read;
+        read.reserve(std::min<uint32_t>(count, (uint32_t)body.size()));
+        ScoreRecord record;
+        for (uint32_t n = 0; n < count; n++) {
+            int32_t rankDelta, scoreDelta;
+            if (!getSigned(body, pos, rankDelta) || !getSigned(body, pos, scoreDelta) || !getString(body, pos, record.name))
+                return false;
+            record.rank += rankDelta;
+            record.score += scoreDelta;
+            read.push_back(record);
+        }
+        etag = readEtag;
+        lastModified = readLastModified;
+        records = std::move(read);
+        return true;
+    }
+};
+
+
+/*
+Scores that are not on the server yet, kept in a journal file until they are 📒
+add() returns at once; the flusher thread first appends the score to the journal (synced to disk), then sends it.
+Whatever is pending goes in one request, up to BATCH_SIZE scores. When that fails, the flusher waits
+FIRST_BACKOFF, then twice as long each time up to MAX_BACKOFF, and tries again; scores from an earlier session
+that never made it are sent the same way. Each score has an idempotency key, so sending it twice (the answer got
+lost, crash right after sending) still stores it once. The answer has the rank each score got, see rank().
+
+The journal is a list of records: varint size, payload, checksum. 'A' key score name adds a score, 'D' key marks it
+sent. A crash mid-append leaves a broken last record, which load drops. Once everything is sent the file goes away.
+*/
+class ScoreJournal {
+public:
+    enum Status { UNKNOWN, QUEUED, OFFLINE, SENT };
+    static const int BATCH_SIZE = 20;
+    static constexpr std::chrono::seconds FIRST_BACKOFF{ 2 };
+    static constexpr std::chrono::seconds MAX_BACKOFF{ 300 };
+
+    ScoreJournal(const std::string& path, HttpWorker& http) : path(path), http(http) {
+        flusher = std::thread([this] { run(); });
+    }
+
+    ~ScoreJournal() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        flusher.join();
+    }
+
+    // returns the score's key for status()
+    std::string add(const std::string& name, int score) {
+        ScoreSubmission submission{ newKey(), name, score };
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            added.push_back(submission);
+            statuses[submission.key] = QUEUED;
+        }
+        wake.notify_one();
+        return submission.key;
+    }
+
+    // 16 random hex digits, unique enough for create.php's request_key (the load test makes its own too)
+    static std::string newKey() {
+        static std::mutex keyMutex;
+        static std::mt19937_64 keys(std::random_device{}() ^ (uint64_t)Clock::now().time_since_epoch().count());
+        std::lock_guard<std::mutex> lock(keyMutex);
+        char key[17];
+        snprintf(key, sizeof key, "%016llx", (unsigned long long)keys());
+        return key;
+    }
+
+    Status status(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = statuses.find(key);
+        return found == statuses.end() ? UNKNOWN : found->second;
+    }
+
+    // the rank the server gave the score once it is SENT, 0 before (or if the answer had none)
+    int rank(const std::string& key) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = ranks.find(key);
+        return found == ranks.end() ? 0 : found->second;
+    }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    std::string path;
+    HttpWorker& http;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<ScoreSubmission> added;         // from add(), not in the journal yet
+    std::map<std::string, Status> statuses;
+    std::map<std::string, int> ranks;
+    bool stopping = false;
+    std::thread flusher;
+
+    // flusher thread only
+    std::vector<ScoreSubmission> pending;       // in the journal, not sent yet
+    int failures = 0;
+    Clock::time_point retryAt;
+
+    void run() {
+        load();
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            std::vector<ScoreSubmission> fresh;
+            fresh.swap(added);
+            lock.unlock();
+
+            if (!fresh.empty()) {
+                std::string records;
+                for (const ScoreSubmission& submission : fresh)
+                    records += record('A', submission);
+                if (!appendDurably(path, records))
+                    std::cerr << "Could not write the score journal " << path << ", sending anyway" << std::endl;
+                pending.insert(pending.end(), fresh.begin(), fresh.end());
+                retryAt = Clock::now();    // a new score is worth trying right away
+            }
+            if (!pending.empty() && Clock::now() >= retryAt)
+                flush();
+
+            lock.lock();
+            if (!added.empty() || stopping)
+                continue;
+            if (pending.empty())
+                wake.wait(lock);
+            else
+                wake.wait_until(lock, retryAt);
+        }
+    }
+
+    void flush() {
+        std::vector<ScoreSubmission> batch(pending.begin(), pending.begin() + std::min<size_t>(pending.size(), BATCH_SIZE));
+        // the flusher does its own backoff, one attempt per round
+        auto answerParser = std::make_shared<ScoreListParser>();
+        std::future<HttpResponse> answer = submitScores(http, batch, 10L, 1, answerParser);
+        while (answer.wait_for(std::chrono::milliseconds(100)) != std::future_status::ready) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stopping)
+                return;     // still in the journal, the next start sends it again
+        }
+        HttpResponse response = answer.get();
+
+        if (response.result != CURLE_OK || answerParser->status != 201) {
+            failures++;
+            retryAt = Clock::now() + std::min<Clock::duration>(FIRST_BACKOFF * (1 << std::min(failures - 1, 16)), MAX_BACKOFF);
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const ScoreSubmission& submission : batch)
+                statuses[submission.key] = OFFLINE;
+            return;
+        }
+
+        failures = 0;
+        pending.erase(pending.begin(), pending.begin() + batch.size());
+        if (pending.empty()) {
+            std::error_code ignored;
+            std::filesystem::remove(path, ignored);
+        } else {
+            std::string records;
+            for (const ScoreSubmission& submission : batch)
+                records += record('D', submission);
+            appendDurably(path, records);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const ScoreSubmission& submission : batch)
+            statuses[submission.key] = SENT;
+        for (const ScoreRecord& answer : answerParser->records) {
+            if (answer.rank > 0)
+                ranks[answer.key] = answer.rank;
+        }
+    }
+
+    static std::string record(char type, const ScoreSubmission& submission) {
+        std::string payload(1, type);
+        putString(payload, submission.key);
+        if (type == 'A') {
+            putSigned(payload, submission.score);
+            putString(payload, submission.name);
+        }
+        appendChecksum(payload);
+        std::string out;
+        putVarint(out, payload.size());
+        return out + payload;
+    }
+
+    // everything not marked sent becomes pending; a broken tail or sent scores are cleaned out of the file
+    void load() {
+        std::string data;
+        if (!readFile(path, data))
+            return;
+        size_t pos = 0;
+        bool clean = true;
+        bool torn = false;
+        std::vector<ScoreSubmission> found;
+        while (pos < data.size()) {
+            uint32_t size;
+            std::string payload;
+            if (!getVarint(data, pos, size) || size > data.size() - pos || !stripChecksum(data.substr(pos, size), payload)) {
+                clean = false;
+                torn = true;
+                break;
+            }
+            pos += size;
+
+            size_t at = 1;
+            ScoreSubmission submission;
+            if (payload.empty() || !getString(payload, at, submission.key)) {
+                clean = false;
+                break;
+            }
+            if (payload[0] == 'D') {
+                clean = false;
+                found.erase(std::remove_if(found.begin(), found.end(), [&](const ScoreSubmission& s) { return s.key == submission.key; }), found.end());
+                continue;
+            }
+            int32_t score;
+            if (!getSigned(payload, at, score) || !getString(payload, at, submission.name)) {
+                clean = false;
+                break;
+            }
+            submission.score = score;
+            found.push_back(submission);
+        }
+
+        if (!clean) {
+            std::string records;
+            for (const ScoreSubmission& submission : found)
+                records += record('A', submission);
+            writeFileAtomically(path, records);
+        }
+        pending = found;
+        if (torn)
+            std::cerr << "Score journal " << path << " ended in a broken record (crash while writing?), dropped it" << std::endl;
+    }
+};
+
+
+// ---------------------------- THREADING ------------------------------
+
+/*
+Thread pool where every worker has its own job queue 🧵
+Workers take jobs from the back of their own queue and steal from the front of the others when they run dry,
+so a few long jobs don't leave the rest of the cores waiting.
+
+    void submit(std::function<void()> job)
+    void wait()     blocks until every submitted job is done
+*/
+class WorkStealingPool {
+public:
+    WorkStealingPool(int threadCount = std::thread::hardware_concurrency()) {
+        threadCount = std::max(threadCount, 1);
+        for (int i = 0; i < threadCount; i++)
+            queues.emplace_back(new JobQueue());
+        for (int i = 0; i < threadCount; i++)
+            workers.emplace_back([this, i] { work(i); });
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    int size() const {
+        return (int)workers.size();
+    }
+
+    void submit(std::function<void()> job) {
+        unfinished++;
+        JobQueue& queue = *queues[nextQueue++ % queues.size()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back(std::move(job));
+        }
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            queued++;
+        }
+        jobAvailable.notify_one();
+    }
+
+    void wait() {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        allDone.wait(lock, [this] { return unfinished == 0; });
+    }
+
+private:
+    struct JobQueue {
+        std::deque<std::function<void()>> jobs;
+        std::mutex mutex;
+    };
+
+    std::vector<std::unique_ptr<JobQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> unfinished{0};
+    std::atomic<unsigned> nextQueue{0};
+    int queued = 0;
+    bool stopping = false;
+    std::mutex sleepMutex;
+    std::condition_variable jobAvailable;
+    std::condition_variable allDone;
+
+    bool takeJob(int self, std::function<void()>& job) {
+        // own queue first, newest job (still warm in the cache)
+        {
+            JobQueue& own = *queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        // then steal the oldest job from someone else
+        for (size_t i = 1; i < queues.size(); i++) {
+            JobQueue& victim = *queues[(self + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void work(int self) {
+        std::function<void()> job;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(sleepMutex);
+                jobAvailable.wait(lock, [this] { return queued > 0 || stopping; });
+                if (queued == 0)
+                    return;
+                queued--;
+            }
+            // a job was counted for us, it might just sit in another queue
+            while (!takeJob(self, job))
+                std::this_thread::yield();
+            job();
+            job = nullptr;
+
+            if (--unfinished == 0) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                allDone.notify_all();
+            }
+        }
+    }
+};
+
+
+// ---------------------------- PROFILER ------------------------------
+
+/*
+Ring buffer for exactly one producer thread and one consumer thread, no locks 🔁
+push() fails instead of waiting when the consumer falls behind; the caller decides what to drop.
+*/
+template <typename T>
+class SpscRing {
+public:
+    // capacity gets rounded up to a power of two
+    SpscRing(size_t capacity) {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        items.resize(size);
+        mask = size - 1;
+    }
+
+    bool push(const T& item) {
+        size_t head = writeIndex.load(std::memory_order_relaxed);
+        if (head - readIndex.load(std::memory_order_acquire) > mask)
+            return false;
+        items[head & mask] = item;
+        writeIndex.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        size_t tail = readIndex.load(std::memory_order_relaxed);
+        if (tail == writeIndex.load(std::memory_order_acquire))
+            return false;
+        item = items[tail & mask];
+        readIndex.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> items;
+    size_t mask;
+    std::atomic<size_t> writeIndex{0};
+    std::atomic<size_t> readIndex{0};
+};
+
+
+// One timed span, counter sample or mark as it goes to the trace file
+struct ProfileEvent {
+    const char* name;   // string literal or Profiler::typeName(), never freed
+    int64_t start;      // µs since the profiler was created
+    int64_t duration;   // µs, the value for counters
+    char type;          // trace event phase: 'X' span, 'C' counter, 'i' mark
+};
+
+// The Game queries that scan every entity, counted by Profiler::countQuery()
+enum QueryFunction {
+    QUERY_GET_COLLISIONS,
+    QUERY_GET_GRID_COLLISIONS,
+    QUERY_GET_GRID_COLLISIONS_AROUND,
+    QUERY_HAS_GRID_COLLISION,
+    QUERY_HAS_ZOMBIE_ON_ROW_BEFORE,
+    QUERY_FIND_ENTITY,
+    QUERY_GET_LANE_ZOMBIES,
+    QUERY_FUNCTIONS
+};
+
+const char* QUERY_NAMES[QUERY_FUNCTIONS] = {
+    "getCollisions", "getGridCollisions", "getGridCollisionsAround", "hasGridCollision", "hasZombieOnRowBefore", "findEntity",
+    "getLaneZombies"
+};
+
+struct QueryCost {
+    int64_t calls = 0;
+    int64_t scanned = 0;    // entities looked at
+    int64_t matches = 0;    // entities returned (or 1 for a true bool)
+    int64_t bytes = 0;      // allocated for the result vectors
+};
+
+/*
+Frame profiler for the game thread ⏱️
+Phases are timed with phase() or ProfileScope, the totals of the last frames are shown by drawOverlay() (F3 in game).
+While a trace is running (F4) every span also goes through a ring buffer to a writer thread,
+which writes Chrome trace JSON (open it in chrome://tracing or ui.perfetto.dev).
+
+Entity ticks are summed up per entity type instead of traced one by one, they go into the trace as counters.
+
+mark() notes single moments, e.g. every decision of the QualityGovernor.
+
+Query costs (countQuery()) are kept per query function and per calling entity type. The overlay shows the
+per frame average of the last second, writeQueryReport() the totals since the last resetQueryCosts().
+*/
+class Profiler {
+public:
+    bool overlayVisible = false;
+    static const int HISTORY = 240; // frames in the graph
+
+    Profiler() : epoch(std::chrono::steady_clock::now()), ring(1 << 16) {}
+
+    ~Profiler() {
+        stopTrace();
+    }
+
+    int64_t now() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    // readable class name of an entity (typeid(*entity)), the pointer stays valid
+    const char* typeName(const std::type_info& type) {
+        auto found = typeNames.find(std::type_index(type));
+        if (found != typeNames.end())
+            return found->second.c_str();
+
+        // gcc/mingw: "6Zombie", msvc: "class Zombie"
+        std::string name = type.name();
+        if (name.rfind("class ", 0) == 0)
+            name = name.substr(6);
+        size_t digits = 0;
+        while (digits < name.size() && std::isdigit((unsigned char)name[digits]))
+            digits++;
+        name = name.substr(digits);
+        return typeNames.emplace(std::type_index(type), name).first->second.c_str();
+    }
+
+    void beginFrame() {
+        int64_t start = now();
+        if (frameStart >= 0)
+            frameMillis[frameIndex % HISTORY] = (start - frameStart) / 1000.f;
+        frameStart = start;
+        currentPhase = nullptr;
+        for (Stat& stat : stats) {
+            stat.frameMicros = 0;
+            stat.frameCount = 0;
+        }
+    }
+
+    // call before sleeping, the rest of the frame is idle time
+    void endFrame() {
+        phase(nullptr);
+        int64_t end = now();
+        workMillis[frameIndex % HISTORY] = (end - frameStart) / 1000.f;
+        emit({ "frame", frameStart, end - frameStart, 'X' });
+
+        for (Stat& stat : stats) {
+            // roughly the average over the last second
+            stat.averageMicros += (stat.frameMicros - stat.averageMicros) * 0.05f;
+            stat.averageCount += (stat.frameCount - stat.averageCount) * 0.05f;
+            if (stat.entityType && stat.frameCount > 0)
+                emit({ stat.name, frameStart, stat.frameMicros, 'C' });
+        }
+        frameIndex++;
+
+        queryTicks++;
+        if (++windowFrames == 60) {
+            for (QueryRow& row : queryRows) {
+                for (int f = 0; f < QUERY_FUNCTIONS; f++) {
+                    QueryCost& cost = row.window[f];
+                    row.shown[f] = { cost.calls / 60, cost.scanned / 60, cost.matches / 60, cost.bytes / 60 };
+                    cost = QueryCost();
+                }
+            }
+            windowFrames = 0;
+        }
+    }
+
+    // ends the running phase and starts the next one, for code that runs one phase after another
+    void phase(const char* name) {
+        int64_t start = now();
+        if (currentPhase != nullptr)
+            record(currentPhase, phaseStart, start - phaseStart);
+        currentPhase = name;
+        phaseStart = start;
+    }
+
+    void countQuery(QueryFunction function, const char* caller, int64_t scanned, int64_t matches, int64_t bytes) {
+        QueryRow& row = queryRowFor(caller);
+        for (QueryCost* cost : { &row.window[function], &row.total[function] }) {
+            cost->calls++;
+            cost->scanned += scanned;
+            cost->matches += matches;
+            cost->bytes += bytes;
+        }
+    }
+
+    void resetQueryCosts() {
+        queryRows.clear();
+        queryTicks = 0;
+        windowFrames = 0;
+    }
+
+    // CSV, most scanned first; ticks are the frames since resetQueryCosts()
+    bool writeQueryReport(const std::string& path) const {
+        std::vector<std::pair<const QueryRow*, int>> lines;
+        for (const QueryRow& row : queryRows) {
+            for (int f = 0; f < QUERY_FUNCTIONS; f++) {
+                if (row.total[f].calls > 0)
+                    lines.push_back({ &row, f });
+            }
+        }
+        std::sort(lines.begin(), lines.end(), [](const auto& a, const auto& b) {
+            return a.first->total[a.second].scanned > b.first->total[b.second].scanned;
+        });
+
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+            return false;
+        int64_t ticks = std::max<int64_t>(queryTicks, 1);
+        file << "caller,function,calls,calls_per_tick,scanned,scanned_per_tick,scanned_per_call,matches,bytes,bytes_per_tick\n";
+        for (const auto& line : lines) {
+            const QueryCost& cost = line.first->total[line.second];
+            file << line.first->caller << "," << QUERY_NAMES[line.second] << ","
+                 << cost.calls << "," << (double)cost.calls / ticks << ","
+                 << cost.scanned << "," << (double)cost.scanned / ticks << "," << (double)cost.scanned / cost.calls << ","
+                 << cost.matches << "," << cost.bytes << "," << (double)cost.bytes / ticks << "\n";
+        }
+        return (bool)file;
+    }
+
+    void record(const char* name, int64_t start, int64_t duration, bool entityType = false) {
+        Stat& stat = statFor(name, entityType);
+        stat.frameMicros += duration;
+        stat.frameCount++;
+        if (!entityType)
+            emit({ name, start, duration, 'X' });
+    }
+
+    // something that happened (like a quality change), a line in the trace and in the overlay
+    void mark(const char* name) {
+        int64_t at = now();
+        emit({ name, at, 0, 'i' });
+        marks.push_back({ name, at });
+        if (marks.size() > 4)
+            marks.pop_front();
+    }
+
+    bool isTracing() const {
+        return tracing;
+    }
+
+    bool startTrace(const std::string& path) {
+        if (tracing)
+            return true;
+        traceFile.open(path, std::ios::trunc);
+        if (!traceFile) {
+            std::cerr << "profiler: can't write " << path << std::endl;
+            return false;
+        }
+        traceFile << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"
+                  << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"game\"}}";
+        droppedEvents = 0;
+        writerStopping = false;
+        tracing = true;
+        writer = std::thread([this] { writeTrace(); });
+        return true;
+    }
+
+    void stopTrace() {
+        if (!tracing)
+            return;
+        tracing = false;
+        writerStopping = true;
+        writer.join();
+        traceFile << "\n]}\n";
+        traceFile.close();
+        if (droppedEvents > 0)
+            std::cerr << "profiler: trace writer fell behind, dropped " << droppedEvents << " events" << std::endl;
+    }
+
+    // status is one more line under the frame time, e.g. FramePacer::summary()
+    void drawOverlay(sf::RenderTarget& target, const sf::Font& font, const std::string& status = "") {
+        const float left = 10.f, top = 10.f, width = 2.f * HISTORY, graphHeight = 100.f;
+        const float msToPixels = graphHeight / 33.3f; // two frames at 60 fps fill the graph
+
+        std::ostringstream text;
+        text.setf(std::ios::fixed);
+        text.precision(2);
+        int last = (frameIndex + HISTORY - 1) % HISTORY;
+        text << "frame " << frameMillis[last] << " ms, work " << workMillis[last] << " ms"
+             << (tracing ? "   [F4] tracing to trace.json" : "   [F4] start trace") << "\n";
+        if (!status.empty())
+            text << status << "\n";
+        for (const Stat& stat : stats) {
+            if (stat.entityType)
+                continue;
+            text << stat.name << "  " << stat.averageMicros / 1000.f << " ms\n";
+        }
+        for (const Mark& mark : marks)
+            text << (now() - mark.at) / 1000000 << " s ago: " << mark.name << "\n";
+        text << "entity ticks:\n";
+        for (const Stat& stat : stats) {
+            if (!stat.entityType || stat.averageCount < 0.5f)
+                continue;
+            text << "  " << stat.name << "  " << stat.averageMicros / 1000.f << " ms  (" << (int)(stat.averageCount + 0.5f) << ")\n";
+        }
+        text << "queries per frame: calls / scanned / matches / bytes\n";
+        for (int f = 0; f < QUERY_FUNCTIONS; f++) {
+            QueryCost sum;
+            for (const QueryRow& row : queryRows) {
+                sum.calls += row.shown[f].calls;
+                sum.scanned += row.shown[f].scanned;
+                sum.matches += row.shown[f].matches;
+                sum.bytes += row.shown[f].bytes;
+            }
+            if (sum.calls == 0)
+                continue;
+            text << "  " << QUERY_NAMES[f] << "  " << sum.calls << " / " << sum.scanned << " / " << sum.matches << " / " << sum.bytes << "\n";
+            for (const QueryRow& row : queryRows) {
+                const QueryCost& cost = row.shown[f];
+                if (cost.calls > 0)
+                    text << "      " << row.caller << "  " << cost.calls << " / " << cost.scanned << " / " << cost.matches << " / " << cost.bytes << "\n";
+            }
+        }
+
+        sf::Text lines(text.str(), font, 13);
+        lines.setPosition(left + 4.f, top + graphHeight + 6.f);
+
+        sf::RectangleShape background(sf::Vector2f(width + 8.f, graphHeight + lines.getLocalBounds().height + 20.f));
+        background.setPosition(left - 4.f, top - 4.f);
+        background.setFillColor(sf::Color(0, 0, 0, 170));
+        target.draw(background);
+
+        // work time as bars, time between frames as a line, oldest frame on the left
+        sf::VertexArray bars(sf::Lines);
+        sf::VertexArray frameLine(sf::LineStrip);
+        for (int i = 0; i < HISTORY; i++) {
+            int index = (frameIndex + i) % HISTORY;
+            float x = left + i * 2.f;
+            float bottom = top + graphHeight;
+            float work = std::min(workMillis[index] * msToPixels, graphHeight);
+            float frame = std::min(frameMillis[index] * msToPixels, graphHeight);
+            sf::Color barColor = workMillis[index] > 16.7f ? sf::Color(230, 80, 80) : sf::Color(90, 200, 90);
+            bars.append(sf::Vertex(sf::Vector2f(x, bottom), barColor));
+            bars.append(sf::Vertex(sf::Vector2f(x, bottom - work), barColor));
+            frameLine.append(sf::Vertex(sf::Vector2f(x, bottom - frame), sf::Color(240, 220, 90)));
+        }
+        sf::VertexArray budget(sf::Lines);
+        budget.append(sf::Vertex(sf::Vector2f(left, top + graphHeight - 16.7f * msToPixels), sf::Color(255, 255, 255, 120)));
+        budget.append(sf::Vertex(sf::Vector2f(left + width, top + graphHeight - 16.7f * msToPixels), sf::Color(255, 255, 255, 120)));
+
+        target.draw(bars);
+        target.draw(budget);
+        target.draw(frameLine);
+        target.draw(lines);
+    }
+
+private:
+    struct Stat {
+        const char* name;
+        bool entityType;
+        int64_t frameMicros = 0;
+        int frameCount = 0;
+        float averageMicros = 0.f;
+        float averageCount = 0.f;
+    };
+
+    std::chrono::steady_clock::time_point epoch;
+    std::vector<Stat> stats; // few enough to search linearly, names are compared by pointer
+    std::map<std::type_index, std::string> typeNames;
+
+    int64_t frameStart = -1;
+    const char* currentPhase = nullptr;
+    int64_t phaseStart = 0;
+    int frameIndex = 0;
+    float frameMillis[HISTORY] = {};
+    float workMillis[HISTORY] = {};
+
+    struct QueryRow {
+        const char* caller;
+        QueryCost window[QUERY_FUNCTIONS];  // summed up over the running second
+        QueryCost shown[QUERY_FUNCTIONS];   // per frame average of the last full second
+        QueryCost total[QUERY_FUNCTIONS];
+    };
+    std::vector<QueryRow> queryRows;
+    int64_t queryTicks = 0;
+
+    struct Mark {
+        const char* name;
+        int64_t at;
+    };
+    std::deque<Mark> marks;
+    int windowFrames = 0;
+
+    SpscRing<ProfileEvent> ring;
+    std::atomic<bool> tracing{false};
+    std::atomic<bool> writerStopping{false};
+    int droppedEvents = 0;
+    std::thread writer;
+    std::ofstream traceFile; // only touched by the writer while tracing
+
+    Stat& statFor(const char* name, bool entityType) {
+        for (Stat& stat : stats) {
+            if (stat.name == name)
+                return stat;
+        }
+        stats.push_back(Stat{ name, entityType });
+        return stats.back();
+    }
+
+    QueryRow& queryRowFor(const char* caller) {
+        for (QueryRow& row : queryRows) {
+            if (row.caller == caller)
+                return row;
+        }
+        queryRows.emplace_back();
+        queryRows.back().caller = caller;
+        return queryRows.back();
+    }
+
+    void emit(const ProfileEvent& event) {
+        if (tracing && !ring.push(event))
+            droppedEvents++;
+    }
+
+    void writeTrace() {
+        ProfileEvent event;
+        while (true) {
+            bool stopping = writerStopping;
+            while (ring.pop(event)) {
+                traceFile << ",\n{\"name\":\"" << event.name << "\",\"pid\":1,\"tid\":1,\"ts\":" << event.start;
+                if (event.type == 'C')
+                    traceFile << ",\"ph\":\"C\",\"args\":{\"us\":" << event.duration << "}}";
+                else if (event.type == 'i')
+                    traceFile << ",\"ph\":\"i\",\"s\":\"g\"}";
+                else
+                    traceFile << ",\"ph\":\"X\",\"dur\":" << event.duration << "}";
+            }
+            // everything pushed before the stop request is written now
+            if (stopping)
+                return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+};
+
+// Times the enclosing block; does nothing when there is no profiler (headless games)
+class ProfileScope {
+public:
+    ProfileScope(Profiler* profiler, const char* name, bool entityType = false)
+        : profiler(profiler), name(name), entityType(entityType) {
+        if (profiler != nullptr)
+            start = profiler->now();
+    }
+
+    ~ProfileScope() {
+        if (profiler != nullptr)
+            profiler->record(name, start, profiler->now() - start, entityType);
+    }
+
+private:
+    Profiler* profiler;
+    const char* name;
+    bool entityType;
+    int64_t start = 0;
+};
+
+
+/*
+Keeps frames inside their budget by turning off what only looks nice 🎚️
+Each level sheds one more thing (see Detail), the simulation is never touched.
+It sheds when the work of the last WINDOW frames averages over SHED_AT of the budget, and only brings detail back
+after RESTORE_FRAMES frames in a row below RESTORE_AT, so it doesn't flip back and forth. After every change it
+waits SETTLE_FRAMES for the change to show up in the frame times.
+*/
+class QualityGovernor {
+public:
+    enum Detail {
+        FULL,
+        NO_WOBBLE,          // zombies stop tilting
+        NO_HEALTH_LABELS,   // no text under hurt entities
+        FOCUS_ANIMATION,    // only entities near the mouse animate, the rest hold their frame
+        DETAILS
+    };
+    static constexpr const char* DETAIL_NAMES[DETAILS] = {
+        "quality: full", "quality: no zombie wobble", "quality: no health labels", "quality: animations near the mouse only"
+    };
+    static const int WINDOW = 30;
+    static constexpr float SHED_AT = 0.9f;
+    static constexpr float RESTORE_AT = 0.5f;
+    static const int RESTORE_FRAMES = 120;
+    static const int SETTLE_FRAMES = 30;
+
+    int level = FULL;
+
+    bool wobble() const { return level < NO_WOBBLE; }
+    bool healthLabels() const { return level < NO_HEALTH_LABELS; }
+    bool animateEverywhere() const { return level < FOCUS_ANIMATION; }
+
+    // after each frame with the time it worked (without sleeping); tells the profiler when it changes the level
+    void frameDone(float workMillis, float budgetMillis, Profiler* profiler) {
+        recent[frames++ % WINDOW] = workMillis;
+        if (frames < WINDOW || frames - changedAt < SETTLE_FRAMES)
+            return;
+
+        float average = 0.f;
+        for (float millis : recent)
+            average += millis / WINDOW;
+        calmFrames = average < budgetMillis * RESTORE_AT ? calmFrames + 1 : 0;
+
+        int wanted = level;
+        if (average > budgetMillis * SHED_AT && level < DETAILS - 1)
+            wanted = level + 1;
+        else if (calmFrames >= RESTORE_FRAMES && level > FULL)
+            wanted = level - 1;
+        if (wanted == level)
+            return;
+
+        level = wanted;
+        changedAt = frames;
+        calmFrames = 0;
+        if (profiler != nullptr)
+            profiler->mark(DETAIL_NAMES[level]);
+    }
+
+private:
+    float recent[WINDOW] = {};
+    int64_t frames = 0;
+    int64_t changedAt = 0;
+    int calmFrames = 0;
+};
+
+
+// ---------------------------- FRAME PACING ------------------------------
+
+enum ProcessPriority {
+    PRIORITY_NORMAL,
+    PRIORITY_HIGH   // the game, so the scheduler wakes us on time
+};
+
+// only a hint: without the rights for it (Linux needs CAP_SYS_NICE or RLIMIT_NICE to go below 0) it returns false and nothing changes
+bool setProcessPriority(ProcessPriority priority) {
+#ifdef _WIN32
+    return SetPriorityClass(GetCurrentProcess(), priority == PRIORITY_HIGH ? HIGH_PRIORITY_CLASS : NORMAL_PRIORITY_CLASS) != 0;
+#else
+    return setpriority(PRIO_PROCESS, 0, priority == PRIORITY_HIGH ? -5 : 0) == 0;
+#endif
+}
+
+/*
+Waits for the next frame without oversleeping 🏁
+Sleeping alone wakes up whenever the scheduler gets to it, often a whole quantum late. So wait() sleeps (sf::sleep)
+until spinMargin before the deadline and spins the rest on steady_clock. The margin follows how late the sleeps
+actually wake up.
+Deadlines are one period apart from each other, not from when wait() returns, so short waits don't add up to drift.
+With vsync on display() blocks until the monitor is ready as well, the deadlines still keep the game at FRAME_RATE on
+faster monitors.
+intervals() keeps the time between the last HISTORY frames for summary(), which the F3 overlay shows.
+*/
+class FramePacer {
+public:
+    using Clock = std::chrono::steady_clock;
+    static const int HISTORY = 600; // 10 seconds at 60 fps
+
+    void start(float framesPerSecond) {
+        period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+        lastFrame = Clock::now();
+        deadline = lastFrame + period;
+        count = 0;
+    }
+
+    void wait() {
+        Clock::time_point wake = deadline - spinMargin;
+        Clock::time_point now = Clock::now();
+        if (now < wake) {
+            // sf::sleep, not sleep_until: on Windows it raises the timer resolution to 1 ms around the sleep,
+            // without that Sleep() wakes up to 15.6 ms late, more than MAX_SPIN can absorb
+            sf::sleep(sf::microseconds(std::chrono::duration_cast<std::chrono::microseconds>(wake - now).count()));
+            // keep the margin a bit above the latest wake ups, shrink it again slowly when sleeping gets precise
+            Clock::duration late = Clock::now() - wake;
+            spinMargin = std::clamp(std::max(late + std::chrono::microseconds(250), spinMargin - std::chrono::microseconds(10)),
+                                    MIN_SPIN, MAX_SPIN);
+        }
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+
+        now = Clock::now();
+        intervals[count++ % HISTORY] = std::chrono::duration<float, std::milli>(now - lastFrame).count();
+        lastFrame = now;
+        deadline += period;
+        // more than a frame behind (window dragged, breakpoint): start over instead of rushing to catch up
+        if (deadline < now)
+            deadline = now + period;
+    }
+
+    // milliseconds between frames: median, 99th percentile and worst, how far the 99th is off the period, spin margin
+    std::string summary() const {
+        int n = (int)std::min<int64_t>(count, HISTORY);
+        if (n == 0)
+            return "";
+        std::vector<float> sorted(intervals, intervals + n);
+        std::sort(sorted.begin(), sorted.end());
+        float target = std::chrono::duration<float, std::milli>(period).count();
+        std::vector<float> jitter(n);
+        for (int i = 0; i < n; i++)
+            jitter[i] = std::abs(sorted[i] - target);
+        std::sort(jitter.begin(), jitter.end());
+
+        std::ostringstream text;
+        text.setf(std::ios::fixed);
+        text.precision(2);
+        text << "pacing p50 " << sorted[n / 2] << " / p99 " << sorted[n * 99 / 100] << " / max " << sorted[n - 1]
+             << " ms, jitter p99 " << jitter[n * 99 / 100] << " ms, spin " << std::chrono::duration<float, std::milli>(spinMargin).count() << " ms";
+        return text.str();
+    }
+
+private:
+    static constexpr Clock::duration MIN_SPIN = std::chrono::microseconds(500);
+    static constexpr Clock::duration MAX_SPIN = std::chrono::milliseconds(4);
+
+    Clock::duration period = std::chrono::milliseconds(16);
+    Clock::duration spinMargin = std::chrono::milliseconds(2);
+    Clock::time_point deadline;
+    Clock::time_point lastFrame;
+    float intervals[HISTORY] = {};
+    int64_t count = 0;
+};
+
+
+// Numbers that decide how hard the game is; the batch simulator (--simulate) sweeps over them 🎛️
+struct Balance {
+    int zombieChance = 500;         // a zombie spawns with a 1 in zombieChance chance every tick
+    int waveStartTicks = 3600;      // calm for a minute...
+    int waveEndTicks = 5400;        // ...then zombies come a lot faster until here
+    int plantPrices[7] = { 3, 5, 4, 10, 1, 5, 20 };   // indexed like Game::selectedPlant
+    float productionDelay = 5.f;    // seconds a ProductionPlant needs per banana
 };
 
 
-// Every other game object (Entity) must inherit from this class 🏛️
-// It provides basic game object functionalities that are used a lot
-// ... add functionality that all entities use here
-class Entity {
+/*
+Changes to the game that entities ask for while the world updates 📋
+Game::simulateTick() records them (one buffer per lane job and one for the game thread) and applies them all
+at the end of the tick in a fixed order, so nothing gets damaged, destroyed or added while others still iterate.
+*/
+struct Command {
+    enum Type { DAMAGE, DESTROY, SPAWN, SCORE, BANANAS, GAME_OVER };
+    Type type;
+    Entity* entity = nullptr;   // the target, or the new entity for SPAWN
+    float amount = 0.f;         // damage, score or bananas
+    int scoreOnKill = 0;        // DAMAGE: added to the score if this hit kills
+};
+
+class CommandBuffer {
 public:
-    float x = 0;
-    float y = 0;
-    float xVel = 0;
-    float yVel = 0;
-    float health = 100;
-    float topHealth = 100;
-    int id = -1;
-    std::string group = "entity";
-    std::string type = "entity";
+    std::vector<Command> commands;
 
-    // animation
-    std::string resDir = "entity";
-    bool pauseAnimation = false;
-    std::vector<sf::Texture> textures;
-    sf::Sprite sprite;
-    int currentFrame = 0;
-    float frameDuration = 0.2f;
-    float frameTimer = 0.f;
-    
-    class Game* game = nullptr;
+    void damage(Entity* target, float amount, int scoreOnKill) {
+        commands.push_back({ Command::DAMAGE, target, amount, scoreOnKill });
+    }
 
-    Entity() {}
+    void destroy(Entity* entity) {
+        commands.push_back({ Command::DESTROY, entity });
+    }
 
-    // use ready() instead of the constructor since class Game* game; isn't defined there yet
-    virtual void ready() {
-        int i = 0;
-        bool loaded = true;
-        while (loaded) {
-            std::string filename = "res/" + resDir + "/" + std::to_string(i) + ".png";
-            sf::Texture texture;
-            if (std::filesystem::exists(filename)) {
-                texture.loadFromFile(filename);
-                textures.push_back(texture);
-                i++;
-            }
-            else {
-                loaded = false;
-            }
-        }
-        sprite.setTexture(textures[0]);
+    void spawn(Entity* entity) {
+        commands.push_back({ Command::SPAWN, entity });
     }
 
-    virtual void updateAnimation(float dt) {
-        if (pauseAnimation)
-            return;
-        frameTimer += dt;
-        if (frameTimer >= frameDuration) {
-            frameTimer = 0.0f;
-            currentFrame = (currentFrame + 1) % textures.size();
-            sprite.setTexture(textures[currentFrame]);
-        }
+    void addScore(int points) {
+        commands.push_back({ Command::SCORE, nullptr, (float)points });
     }
 
-    // defined below Game class because they use Game class functions
-    virtual bool damage(float d);
-    virtual void tick();
-    GridPos getGridPos();
-    void setGridPos(GridPos gridPos);
+    void addBananas(int bananas) {
+        commands.push_back({ Command::BANANAS, nullptr, (float)bananas });
+    }
+
+    void gameOver() {
+        commands.push_back({ Command::GAME_OVER });
+    }
 };
 
 
 /*
 The Game class holds all game objects as entities (std::vector<Entity*> entityCollection) and makes them tick() 🐒
-It also offers commonly used functions and holds a reference to the game window (sf::RenderWindow& gameWindow) ✈️
+It also offers commonly used functions and holds a pointer to the game window (sf::RenderWindow* gameWindow) ✈️
 To access it's members in an Entity use the game pointer: game->handyFunction(x,y);
 
 Manage entities at runtime:
     int createEntity(Entity* entity)
-    void destroyEntity(int entityId)
+    void destroyEntity(int entityId) / void destroyEntity(Entity* entity)
+    void damageEntity(Entity* target, float amount, int scoreOnKill = 0)
+    void addScore(int points)
+    void addBananas(int bananas)
+    void setGameOver()
+    (during simulateTick() these are recorded as Commands and applied at the end of the tick, see applyCommands();
+     a deferred createEntity() returns -1, the id is handed out when the entity joins)
 
 Collision checks:
     std::vector<Entity*> getCollisions(int x, int y, int hitRadius, const std::string& groupFilter = "")
     std::vector<Entity*> getGridCollisions(const GridPos collision, const std::string& groupFilter = "")
     std::vector<Entity*> getGridCollisionsAround(const GridPos center, const std::string& groupFilter = "")
     bool hasGridCollision(const GridPos gridPos, const std::string& groupFilter = "")
+    bool hasZombieOnRowBefore(GridPos gridPos)
+    const std::vector<Entity*>& getLaneZombies(int lane)   the row's zombies, kept as they spawn and get buried
+    Entity* findLaneZombie(int lane, int id)    nullptr once it's destroyed
+    (with a profiler set every call is counted per calling entity type, see Profiler::countQuery)
 
 Switching position units:
     float snapOnGrid(float v)   139 -> 150
     float gridToFree(int g)     2 -> 100
     int freeToGrid(float f)     110 -> 2
 
+Saving:
+    void captureSnapshot(GameSnapshot& snapshot)   copy the game state (cheap, call between ticks)
+    void restore(const GameSnapshot& snapshot)     rebuild a saved game
+
+Timers (game thread only, not from inside a lane job):
+    TimerHandle schedule(Entity* owner, int ticks, std::function<void()> callback)    call it in ticks frames
+    TimerHandle scheduleAt(Entity* owner, int tick, std::function<void()> callback)
+    int settledTick()
+    void cancelTimer(Entity* owner, TimerHandle handle)
+    int secondsToTicks(float seconds)
+    bool isLaneActive(int lane)     are there zombies in this row
+    void sleepUntilLaneWakes(Entity* entity, std::function<void()> wake)
+    void watchLane(Entity* entity, LaneWatch changed)   at the end of every tick in which the row's zombies changed
+    void zombieMoved(Entity* zombie)    it started, stopped or got knocked back (fine from its lane job)
+
 Misc:
     float deltaTime()   Time between frames, multiply this with velocity
+    int randomInt(int n)    0 .. n-1, use this instead of rand() so every game has its own random numbers
+    float randomFloat()     0 .. 1
+    void profilePhase(const char* name)     time what follows as name (see Profiler), until the next phase
+    void simulateTick()     advance the game world by one frame without drawing anything
+
+Headless games (Game(balance, seed)) have no window and load no textures, so they need no display or OpenGL;
+the batch simulator and the benchmarks use them. Everything that draws returns right away in them.
+
+When frames take longer than the budget, quality (see QualityGovernor) drops wobble, health labels and off-focus animation
+one step at a time, the simulation itself is never touched.
 
 ... add commonly used functions to this class 🦅
 */
 class Game {
 public:
-    sf::RenderWindow& gameWindow;
-    std::vector<Entity*> entityCollection;
+    sf::RenderWindow* gameWindow = nullptr;    // nullptr in headless games, they draw nothing
+    std::vector<Entity*> entityCollection;  // can hold destroyed entities until buryDestroyedEntities()
 
     float FRAME_RATE = 60.f;
     int GRID_SPACE = 84;
-    int GRID_ROWS = 8;
+    static constexpr int GRID_ROWS = 8;    // also bounds the build orders of balance/sweep.txt
     int WINDOW_WIDTH;
     int WINDOW_HEIGHT;
 
@@ -366,6 +2684,11 @@ public:
     sf::Font font;
     sf::Time delta;
     int uniqueId = 0;
+    int tickCount = 0;
+
+    Balance balance;
+    std::mt19937 rng;
+    bool headless = false;
     
     int bananaCount = 50;
     int editMode = 0; // 0: sleep, 1: build, 2: destroy
@@ -375,12 +2698,60 @@ public:
     bool isGameOver = false;
 
     int waveCount = -500;
-    int zombieChance = 500;
+    int zombieChance = balance.zombieChance;
     int passedWaves = 0;
 
-    Game(sf::RenderWindow& window) : gameWindow(window) {
-        WINDOW_WIDTH = gameWindow.getSize().x;
-        WINDOW_HEIGHT = gameWindow.getSize().y;
+    Autosave* autosave = nullptr;
+    int ticksSinceAutosave = 0;
+
+    Profiler* profiler = nullptr; // F3 overlay, F4 trace; stays nullptr in headless games
+    QualityGovernor quality;      // what drawing may leave out when frames get too slow
+    FramePacer pacer;
+    const char* queryCaller = "Game"; // entity type whose tick() is running, for the query counters
+
+    // one board row during tickLanes(); lane jobs only see their own row
+    struct Lane {
+        std::vector<Entity*> entities;  // everything in the row, only the ones with entity->lane == row tick here
+        int tickers = 0;                // of them with needsTick, a lane of sleeping plants needs no job
+        CommandBuffer commands;
+    };
+    std::vector<Lane> lanes;
+    CommandBuffer commands;             // recorded on the game thread, applied after the lanes'
+    bool updating = false;              // inside simulateTick(), changes get recorded
+
+    TimerWheel timers;
+    std::vector<TimerWheel::Fired> firedTimers;
+
+    // a row without zombies is dormant: its plants don't attack until one walks in (see sleepUntilLaneWakes())
+    struct Sleeper {
+        Entity* entity;
+        std::function<void()> wake;
+    };
+    std::vector<int> laneZombies = std::vector<int>(GRID_ROWS);
+    std::vector<std::vector<Sleeper>> laneSleepers = std::vector<std::vector<Sleeper>>(GRID_ROWS);
+    // projectiles work out their hits once and again only when the zombies of their row change (see watchLane())
+    // moved: that zombie spawned or changed its pace, left: it got buried; since the last watchLanes(), each lane
+    // job only touches its own row
+    using LaneWatch = std::function<void(const std::vector<Entity*>& moved, const std::vector<int>& left)>;
+    struct Watcher {
+        Entity* entity;
+        LaneWatch changed;
+        bool fresh = true;      // sees every zombie of the row as moved once
+    };
+    std::vector<std::vector<Watcher>> laneWatchers = std::vector<std::vector<Watcher>>(GRID_ROWS);
+    std::vector<std::vector<int>> laneMoved = std::vector<std::vector<int>>(GRID_ROWS);
+    std::vector<std::vector<int>> laneLeft = std::vector<std::vector<int>>(GRID_ROWS);
+    std::vector<uint8_t> laneFresh = std::vector<uint8_t>(GRID_ROWS);    // a watcher joined
+    std::vector<std::vector<Entity*>> zombiesInLane = std::vector<std::vector<Entity*>>(GRID_ROWS);
+    std::vector<Entity*> laneless;      // lane -1, tick on the game thread after the merge
+    WorkStealingPool* pool = nullptr;   // lanes run on it when set and the board is busy enough
+    int PARALLEL_MIN_ENTITIES = 256;
+    bool lanesInParallel = false;
+    inline static thread_local Lane* activeLane = nullptr;
+
+    Game(sf::RenderWindow& window) : gameWindow(&window), rng(std::random_device()()) {
+        WINDOW_WIDTH = gameWindow->getSize().x;
+        WINDOW_HEIGHT = gameWindow->getSize().y;
         font.loadFromFile("res/arial.ttf");
 
         // do not ask, do not change; it fixes the crashes (keep it on the low)
@@ -389,13 +2760,32 @@ public:
         }
         entityCollection.clear();
 
-        SetPriorityClass(GetCurrentProcess(), HIGH_PRIORITY_CLASS);
+        for (const Archetype& archetype : ARCHETYPES)
+            archetype.prewarm(true);
+
+        setProcessPriority(PRIORITY_HIGH);
+    }
+
+    Game(const Balance& balance, unsigned seed)
+        : balance(balance), rng(seed), headless(true) {
+        WINDOW_WIDTH = 1600;
+        WINDOW_HEIGHT = 837;
+        zombieChance = balance.zombieChance;
+        for (const Archetype& archetype : ARCHETYPES)
+            archetype.prewarm(false);
     }
 
     ~Game() {
-        for (Entity* entity : entityCollection) {
-            destroyEntity(entity->id);
-        }
+        for (Entity* entity : entityCollection)
+            delete entity;
+    }
+
+    int randomInt(int n) {
+        return (int)(rng() % (unsigned)n);
+    }
+
+    float randomFloat() {
+        return std::uniform_real_distribution<float>(0.f, 1.f)(rng);
     }
 
     float deltaTime() {
@@ -414,86 +2804,419 @@ public:
         return gridToFree(freeToGrid(v));
     }
 
+    // where changes go right now, nullptr: apply them right away
+    CommandBuffer* recordingBuffer() {
+        if (activeLane != nullptr)
+            return &activeLane->commands;
+        return updating ? &commands : nullptr;
+    }
+
     int createEntity(Entity* entity) {
+        if (CommandBuffer* buffer = recordingBuffer()) {
+            buffer->spawn(entity);
+            return -1;
+        }
         entity->id = uniqueId++;
         entity->game = this; // Set the game pointer
 
         entityCollection.push_back(entity);
         entity->ready();
+        if (entity->group == "zombie")
+            zombieEntersLane(entity);
         return entity->id;
     }
 
     void destroyEntity(int entityId) {
-        entityCollection.erase(std::remove_if(entityCollection.begin(), entityCollection.end(),
-                        [entityId](const Entity* entity) { return entity->id == entityId; }),
-                        entityCollection.end());
+        for (Entity* entity : entityCollection) {
+            if (entity->id == entityId) {
+                destroyEntity(entity);
+                return;
+            }
+        }
+    }
+
+    // it stays in entityCollection (skipped by queries and ticks) until the end of the tick
+    void destroyEntity(Entity* entity) {
+        if (CommandBuffer* buffer = recordingBuffer())
+            buffer->destroy(entity);
+        else
+            entity->destroyed = true;
+    }
+
+    void damageEntity(Entity* target, float amount, int scoreOnKill = 0) {
+        if (CommandBuffer* buffer = recordingBuffer())
+            buffer->damage(target, amount, scoreOnKill);
+        else if (!target->destroyed && target->damage(amount))
+            score += scoreOnKill;
+    }
+
+    void buryDestroyedEntities() {
+        auto firstDestroyed = std::stable_partition(entityCollection.begin(), entityCollection.end(),
+                                [](const Entity* entity) { return !entity->destroyed; });
+        for (auto it = firstDestroyed; it != entityCollection.end(); it++) {
+            leaveLane(*it);
+            cancelTimers(*it);
+            delete *it;
+        }
+        entityCollection.erase(firstDestroyed, entityCollection.end());
+    }
+
+    void addScore(int points) {
+        if (CommandBuffer* buffer = recordingBuffer())
+            buffer->addScore(points);
+        else
+            score += points;
+    }
+
+    void addBananas(int bananas) {
+        if (CommandBuffer* buffer = recordingBuffer())
+            buffer->addBananas(bananas);
+        else
+            bananaCount += bananas;
+    }
+
+    void setGameOver() {
+        if (CommandBuffer* buffer = recordingBuffer())
+            buffer->gameOver();
+        else
+            isGameOver = true;
+    }
+
+    int secondsToTicks(float seconds) {
+        return std::max(1, (int)std::lround(seconds * FRAME_RATE));
+    }
+
+    // the callback runs on the game thread at the start of a tick, unless owner was destroyed by then
+    TimerHandle schedule(Entity* owner, int ticks, std::function<void()> callback) {
+        TimerHandle handle = timers.schedule(timers.now() + std::max(ticks, 1), owner, std::move(callback));
+        owner->timers.push_back(handle);
+        return handle;
+    }
+
+    // at the start of that tick (the one simulateTick() runs while tickCount == tick), or the next one if it's past
+    TimerHandle scheduleAt(Entity* owner, int tick, std::function<void()> callback) {
+        TimerHandle handle = timers.schedule(std::max<int64_t>(tick, timers.now()), owner, std::move(callback));
+        owner->timers.push_back(handle);
+        return handle;
+    }
+
+    // the tick whose end the board shows, simulateTick() only counts tickCount up at its very end
+    int settledTick() {
+        return (int)timers.now() - 1;
+    }
+
+    // fine for timers that already fired
+    void cancelTimer(Entity* owner, TimerHandle handle) {
+        timers.cancel(handle);
+        std::vector<TimerHandle>& pending = owner->timers;
+        for (size_t i = 0; i < pending.size(); i++) {
+            if (pending[i].index == handle.index && pending[i].generation == handle.generation) {
+                pending[i] = pending.back();
+                pending.pop_back();
+                return;
+            }
+        }
+    }
+
+    void cancelTimers(Entity* entity) {
+        for (TimerHandle handle : entity->timers)
+            timers.cancel(handle);
+        entity->timers.clear();
+    }
+
+    bool isLaneActive(int lane) {
+        return lane < 0 || lane >= GRID_ROWS || laneZombies[lane] > 0;
+    }
+
+    // wake runs (as a timer on the next tick) once a zombie enters the entity's lane
+    void sleepUntilLaneWakes(Entity* entity, std::function<void()> wake) {
+        if (entity->lane < 0 || entity->lane >= GRID_ROWS)
+            return;
+        laneSleepers[entity->lane].push_back({ entity, std::move(wake) });
+    }
+
+    // changed runs on the game thread at the end of every tick in which a zombie entered, left or changed its pace
+    // in the entity's lane, with just those zombies, until the entity is buried. At the end of the tick it starts
+    // watching it gets all zombies of the lane as moved.
+    void watchLane(Entity* entity, LaneWatch changed) {
+        if (entity->lane < 0 || entity->lane >= GRID_ROWS)
+            return;
+        laneWatchers[entity->lane].push_back({ entity, std::move(changed) });
+        laneFresh[entity->lane] = true;
+    }
+
+    void zombieMoved(Entity* zombie) {
+        if (zombie->lane >= 0 && zombie->lane < GRID_ROWS)
+            laneMoved[zombie->lane].push_back(zombie->id);
+    }
+
+    void zombieEntersLane(Entity* zombie) {
+        int lane = zombie->lane;
+        if (lane < 0 || lane >= GRID_ROWS)
+            return;
+        zombiesInLane[lane].push_back(zombie);
+        laneMoved[lane].push_back(zombie->id);
+        if (laneZombies[lane]++ > 0)
+            return;
+        for (Sleeper& sleeper : laneSleepers[lane])
+            schedule(sleeper.entity, 1, std::move(sleeper.wake));
+        laneSleepers[lane].clear();
+    }
+
+    // a buried entity stops counting as a zombie of its lane, or stops waiting for the lane
+    void leaveLane(Entity* entity) {
+        if (entity->lane < 0 || entity->lane >= GRID_ROWS)
+            return;
+        if (entity->group == "zombie") {
+            laneZombies[entity->lane]--;
+            std::vector<Entity*>& zombies = zombiesInLane[entity->lane];
+            zombies.erase(std::find(zombies.begin(), zombies.end(), entity));
+            laneLeft[entity->lane].push_back(entity->id);
+            return;
+        }
+        std::vector<Sleeper>& sleepers = laneSleepers[entity->lane];
+        sleepers.erase(std::remove_if(sleepers.begin(), sleepers.end(),
+                       [entity](const Sleeper& sleeper) { return sleeper.entity == entity; }), sleepers.end());
+        std::vector<Watcher>& watchers = laneWatchers[entity->lane];
+        watchers.erase(std::remove_if(watchers.begin(), watchers.end(),
+                       [entity](const Watcher& watcher) { return watcher.entity == entity; }), watchers.end());
+    }
+
+    // after the tick is applied and buried, so the watchers see where everything ended up; only the lanes that
+    // changed, and there only what changed
+    void watchLanes() {
+        bool changed = false;
+        for (int lane = 0; lane < GRID_ROWS; lane++)
+            changed |= !laneWatchers[lane].empty() && (laneFresh[lane] || !laneMoved[lane].empty() || !laneLeft[lane].empty());
+        if (!changed) {
+            for (int lane = 0; lane < GRID_ROWS; lane++) {
+                laneMoved[lane].clear();
+                laneLeft[lane].clear();
+                laneFresh[lane] = false;
+            }
+            return;
+        }
+
+        ProfileScope scope(profiler, "lane watchers");
+        std::vector<Entity*> moved;
+        for (int lane = 0; lane < GRID_ROWS; lane++) {
+            std::vector<int>& movedIds = laneMoved[lane];
+            std::vector<int>& left = laneLeft[lane];
+            if (!laneWatchers[lane].empty() && (laneFresh[lane] || !movedIds.empty() || !left.empty())) {
+                // the lane's zombies in their order, each once however often it moved (buried ones are gone)
+                moved.clear();
+                if (!movedIds.empty()) {
+                    std::sort(movedIds.begin(), movedIds.end());
+                    for (Entity* zombie : zombiesInLane[lane]) {
+                        if (std::binary_search(movedIds.begin(), movedIds.end(), zombie->id))
+                            moved.push_back(zombie);
+                    }
+                }
+                for (Watcher& watcher : laneWatchers[lane]) {
+                    if (!watcher.fresh && moved.empty() && left.empty())
+                        continue;
+                    if (profiler != nullptr)
+                        queryCaller = profiler->typeName(typeid(*watcher.entity));
+                    if (watcher.fresh)
+                        watcher.changed(zombiesInLane[lane], {});
+                    else
+                        watcher.changed(moved, left);
+                    watcher.fresh = false;
+                }
+            }
+            movedIds.clear();
+            left.clear();
+            laneFresh[lane] = false;
+        }
+        queryCaller = "Game";
+    }
+
+    void fireTimers() {
+        ProfileScope scope(profiler, "timers");
+        timers.advance(firedTimers);
+        for (TimerWheel::Fired& timer : firedTimers) {
+            std::vector<TimerHandle>& pending = timer.owner->timers;
+            for (size_t i = 0; i < pending.size(); i++) {
+                if (pending[i].index == timer.handle.index && pending[i].generation == timer.handle.generation) {
+                    pending[i] = pending.back();
+                    pending.pop_back();
+                    break;
+                }
+            }
+            if (timer.owner->destroyed)
+                continue;
+            if (profiler != nullptr)
+                queryCaller = profiler->typeName(typeid(*timer.owner));
+            timer.callback();
+        }
+        queryCaller = "Game";
+        firedTimers.clear();
+    }
+
+    // lane buffers in row order, then the game thread's, each in the order it was recorded
+    void applyCommands() {
+        ProfileScope scope(profiler, "commands");
+        for (Lane& lane : lanes)
+            applyCommands(lane.commands);
+        applyCommands(commands);
+    }
+
+    void applyCommands(CommandBuffer& buffer) {
+        for (const Command& command : buffer.commands) {
+            switch (command.type) {
+            case Command::DAMAGE:
+                damageEntity(command.entity, command.amount, command.scoreOnKill);
+                break;
+            case Command::DESTROY:
+                destroyEntity(command.entity);
+                break;
+            case Command::SPAWN:
+                createEntity(command.entity);
+                break;
+            case Command::SCORE:
+                score += (int)command.amount;
+                break;
+            case Command::BANANAS:
+                bananaCount += (int)command.amount;
+                break;
+            case Command::GAME_OVER:
+                isGameOver = true;
+                break;
+            }
+        }
+        buffer.commands.clear();
+    }
+
+    // the entities a query looks at: the whole board, or only the row inside a lane job
+    const std::vector<Entity*>& visibleEntities() {
+        return activeLane != nullptr ? activeLane->entities : entityCollection;
+    }
+
+    Entity* findEntity(int entityId) {
+        int scanned = 0;
+        for (Entity* entity : visibleEntities()) {
+            scanned++;
+            if (entity->id == entityId && !entity->destroyed) {
+                countQuery(QUERY_FIND_ENTITY, scanned, 1, 0);
+                return entity;
+            }
+        }
+        countQuery(QUERY_FIND_ENTITY, scanned, 0, 0);
+        return nullptr;
     }
 
     std::vector<Entity*> getCollisions(int x, int y, int hitRadius, const std::string& groupFilter = "") {
         std::vector<Entity*> collisions;
+        int64_t bytes = 0;
 
-        for (Entity* entity : entityCollection) {
+        const std::vector<Entity*>& entities = visibleEntities();
+        for (Entity* entity : entities) {
             // Check if the entity matches the filter and is within the hit radius
             // collision damage should be deltaTime sensitive
-            if ((groupFilter == "" || entity->group == groupFilter) &&
+            if (!entity->destroyed && (groupFilter == "" || entity->group == groupFilter) &&
                 std::hypot(entity->x - x, entity->y - y) <= hitRadius) {
-                collisions.push_back(entity);
+                pushCounted(collisions, entity, bytes);
             }
         }
 
+        countQuery(QUERY_GET_COLLISIONS, entities.size(), collisions.size(), bytes);
         return collisions;
     }
 
     std::vector<Entity*> getGridCollisions(const GridPos collision, const std::string& groupFilter = "") {
         std::vector<Entity*> collisions;
+        int64_t bytes = 0;
 
-        for (Entity* entity : entityCollection) {
-            if ((groupFilter == "" || entity->group == groupFilter) && entity->getGridPos().equals(collision)) {
-                collisions.push_back(entity);
+        const std::vector<Entity*>& entities = visibleEntities();
+        for (Entity* entity : entities) {
+            if (!entity->destroyed && (groupFilter == "" || entity->group == groupFilter) && entity->getGridPos().equals(collision)) {
+                pushCounted(collisions, entity, bytes);
             }
         }
 
+        countQuery(QUERY_GET_GRID_COLLISIONS, entities.size(), collisions.size(), bytes);
         return collisions;
     }
 
     bool hasGridCollision(const GridPos gridPos, const std::string& groupFilter = "") {
-        for (Entity* entity : entityCollection) {
-            if (entity->getGridPos().equals(gridPos) && (groupFilter == "" || entity->group == groupFilter)) {
+        int scanned = 0;
+        for (Entity* entity : visibleEntities()) {
+            scanned++;
+            if (!entity->destroyed && entity->getGridPos().equals(gridPos) && (groupFilter == "" || entity->group == groupFilter)) {
+                countQuery(QUERY_HAS_GRID_COLLISION, scanned, 1, 0);
                 return true;
             }
         }
+        countQuery(QUERY_HAS_GRID_COLLISION, scanned, 0, 0);
         return false;
     }
 
+    // the five getGridCollisions() scans are counted there, this only counts the merged result
+    // (a lane job only sees its own row, entities that need the rows around them have lane -1)
     std::vector<Entity*> getGridCollisionsAround(const GridPos center, const std::string& groupFilter = "") {
         std::vector<Entity*> around;
+        int64_t bytes = 0;
 
-        std::vector<Entity*> inside = getGridCollisions(center, groupFilter);
-        around.insert(around.end(), inside.begin(), inside.end());
-        std::vector<Entity*> above = getGridCollisions(GridPos(center.x, center.y + 1), groupFilter);
-        around.insert(around.end(), above.begin(), above.end());
-        std::vector<Entity*> below = getGridCollisions(GridPos(center.x, center.y - 1), groupFilter);
-        around.insert(around.end(), below.begin(), below.end());
-        std::vector<Entity*> right = getGridCollisions(GridPos(center.x + 1, center.y), groupFilter);
-        around.insert(around.end(), right.begin(), right.end());
-        std::vector<Entity*> left = getGridCollisions(GridPos(center.x - 1, center.y), groupFilter);
-        around.insert(around.end(), left.begin(), left.end());
+        for (GridPos cell : { center, GridPos(center.x, center.y + 1), GridPos(center.x, center.y - 1),
+                              GridPos(center.x + 1, center.y), GridPos(center.x - 1, center.y) }) {
+            for (Entity* entity : getGridCollisions(cell, groupFilter))
+                pushCounted(around, entity, bytes);
+        }
 
+        countQuery(QUERY_GET_GRID_COLLISIONS_AROUND, 0, around.size(), bytes);
         return around;
     }
 
     bool hasZombieOnRowBefore(GridPos gridPos) {
-        for (Entity* entity : entityCollection) {
+        int scanned = 0;
+        for (Entity* entity : visibleEntities()) {
+            scanned++;
             GridPos entityGridPos = entity->getGridPos();
-            if(gridPos.sameYBiggerX(entityGridPos) && entity->group == "zombie") {
+            if(!entity->destroyed && gridPos.sameYBiggerX(entityGridPos) && entity->group == "zombie") {
+                countQuery(QUERY_HAS_ZOMBIE_ON_ROW_BEFORE, scanned, 1, 0);
                 return true;
             }
         }
+        countQuery(QUERY_HAS_ZOMBIE_ON_ROW_BEFORE, scanned, 0, 0);
         return false;
     }
 
+    // in the order they spawned; destroyed ones stay until they are buried at the end of the tick
+    const std::vector<Entity*>& getLaneZombies(int lane) {
+        const std::vector<Entity*>& zombies = zombiesInLane[lane];
+        countQuery(QUERY_GET_LANE_ZOMBIES, zombies.size(), zombies.size(), 0);
+        return zombies;
+    }
+
+    Entity* findLaneZombie(int lane, int id) {
+        int scanned = 0;
+        for (Entity* zombie : zombiesInLane[lane]) {
+            scanned++;
+            if (zombie->id == id) {
+                countQuery(QUERY_GET_LANE_ZOMBIES, scanned, 1, 0);
+                return zombie->destroyed ? nullptr : zombie;
+            }
+        }
+        countQuery(QUERY_GET_LANE_ZOMBIES, scanned, 0, 0);
+        return nullptr;
+    }
+
+    // query cost counters (see Profiler::countQuery), charged to the entity type that is ticking right now
+    void countQuery(QueryFunction function, int64_t scanned, int64_t matches, int64_t bytes) {
+        if (profiler != nullptr && !lanesInParallel)
+            profiler->countQuery(function, queryCaller, scanned, matches, bytes);
+    }
+
+    // push_back that adds up what the vector allocates while growing
+    void pushCounted(std::vector<Entity*>& collisions, Entity* entity, int64_t& bytes) {
+        size_t capacity = collisions.capacity();
+        collisions.push_back(entity);
+        if (collisions.capacity() != capacity)
+            bytes += collisions.capacity() * sizeof(Entity*);
+    }
+
     void renderMouseSelection(){
-        if (editMode == 0)
+        if (editMode == 0 || headless)
             return;
         sf::RectangleShape area;
 
@@ -508,10 +3231,14 @@ public:
         // Draw selection square
         area.setSize(sf::Vector2f(GRID_SPACE, GRID_SPACE));
         area.setPosition(snapOnGrid(mousePos.x),snapOnGrid(mousePos.y));
-        gameWindow.draw(area);
+        gameWindow->draw(area);
+    }
+
+    int placePlant() {
+        return placePlant(GridPos(freeToGrid(mousePos.x), freeToGrid(mousePos.y)), selectedPlant);
     }
 
-    int placePlant();
+    int placePlant(GridPos gridPos, int plantType);
 
     void removePlant() {
         GridPos gridPos(freeToGrid(mousePos.x), freeToGrid(mousePos.y));
@@ -523,11 +3250,48 @@ public:
 
     void spawnZombie(int type);
 
+    void captureSnapshot(GameSnapshot& snapshot) {
+        snapshot.bananaCount = bananaCount;
+        snapshot.score = score;
+        snapshot.waveCount = waveCount;
+        snapshot.zombieChance = zombieChance;
+        snapshot.passedWaves = passedWaves;
+
+        // clear() keeps the capacity, so after the first save this doesn't allocate
+        snapshot.entities.clear();
+        for (Entity* entity : entityCollection) {
+            if (entity->destroyed)
+                continue;
+            int kind = entityKind(entity);
+            snapshot.entities.push_back({ (uint8_t)kind, entity->x, entity->y, entity->xVel, entity->yVel,
+                                          entity->health, entity->topHealth });
+        }
+    }
+
+    void restore(const GameSnapshot& snapshot);
+
+    // hand a copy of this tick's state to the autosave thread, never waits for it
+    void autosaveTick() {
+        if (autosave == nullptr || ++ticksSinceAutosave < autosave->interval)
+            return;
+
+        auto start = std::chrono::steady_clock::now();
+        GameSnapshot* snapshot = autosave->acquire();
+        if (snapshot == nullptr)
+            return;
+        captureSnapshot(*snapshot);
+        autosave->publish();
+        ticksSinceAutosave = 0;
+        autosave->recordCaptureTime(std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count());
+    }
+
     sf::Text generateText(int x, int y) {
 //        sf::Font m_font;
 //        m_font.loadFromFile("res/arial.ttf");
 
         sf::Text text;
+        if (headless)
+            return text;
         text.setFont(font);
         text.setCharacterSize(24);
         text.setFillColor(sf::Color::White);
@@ -536,8 +3300,140 @@ public:
         return text;
     }
 
+    // one frame of the game world: entities, zombie spawning and waves. Drawing is done by drawEntities()
+    void simulateTick() {
+        updating = true;
+        fireTimers();
+        tickLanes();
+
+        ProfileScope scope(profiler, "spawning");
+        // spöwns a sömbie every tick with 1 zu füfhundert chance.
+        if ((randomInt(zombieChance) + 1) == zombieChance) {
+            int whichZombieNumber = randomInt(100);
+            // pushing a default skin 75%
+            if (whichZombieNumber <= 75)
+               spawnZombie(0);
+            else if (whichZombieNumber <= 86 && passedWaves > 0)
+                spawnZombie(1);
+            else if (whichZombieNumber <= 99 && passedWaves > 0) {
+                if (randomInt(2) == 0)
+                    spawnZombie(2);
+                else
+                    spawnZombie(3);
+            }
+        }
+        waveCount++;
+        // noch einerhalb minute hört wave uf
+        if(waveCount >= balance.waveEndTicks) {
+            zombieChance = 200 + passedWaves * 15;
+            waveCount = 0;
+            passedWaves++;
+        // after 1 minute fangt wave aa
+        }else if (waveCount >= balance.waveStartTicks) {
+            // double spawn rate
+            zombieChance = 20 + passedWaves;
+        }
+        updating = false;
+
+        applyCommands();
+        buryDestroyedEntities();
+        watchLanes();
+        tickCount++;
+    }
+
+    /*
+    Entities that stay in their row (zombies, projectiles, most plants) tick in one job per row, on the pool when
+    there is one. Whatever a lane job changes goes into its Lane's CommandBuffer; applyCommands() works through them
+    in row order, so the outcome doesn't depend on the thread count.
+    Entities that reach into other rows (lane -1) tick after the lanes, one after another on the game thread.
+    */
+    void tickLanes() {
+        ProfileScope scope(profiler, "entities");
+        lanes.resize(GRID_ROWS);
+        for (Lane& lane : lanes) {
+            lane.entities.clear();
+            lane.tickers = 0;
+        }
+        laneless.clear();
+        for (Entity* entity : entityCollection) {
+            if (entity->destroyed)
+                continue;
+            if (entity->lane >= 0 && entity->lane < GRID_ROWS) {
+                lanes[entity->lane].entities.push_back(entity);
+                lanes[entity->lane].tickers += entity->needsTick;
+                continue;
+            }
+            laneless.push_back(entity);
+            // zombies still have to find it
+            int row = freeToGrid(entity->y);
+            if (row >= 0 && row < GRID_ROWS)
+                lanes[row].entities.push_back(entity);
+        }
+
+        {
+            ProfileScope lanesScope(profiler, "lanes");
+            lanesInParallel = pool != nullptr && pool->size() > 1 && (int)entityCollection.size() >= PARALLEL_MIN_ENTITIES;
+            if (lanesInParallel) {
+                for (Lane& lane : lanes) {
+                    if (lane.tickers > 0)
+                        pool->submit([this, &lane] { tickLane(lane); });
+                }
+                pool->wait();
+            } else {
+                for (Lane& lane : lanes) {
+                    if (lane.tickers > 0)
+                        tickLane(lane);
+                }
+            }
+            lanesInParallel = false;
+        }
+
+        ProfileScope lanelessScope(profiler, "laneless");
+        for (Entity* entity : laneless) {
+            if (entity->needsTick && !entity->destroyed)
+                tickEntity(entity);
+        }
+    }
+
+    void tickLane(Lane& lane) {
+        int row = (int)(&lane - &lanes[0]);
+        activeLane = &lane;
+        for (Entity* entity : lane.entities) {
+            if (entity->lane == row && entity->needsTick && !entity->destroyed)
+                tickEntity(entity);
+        }
+        activeLane = nullptr;
+    }
+
+    void tickEntity(Entity* entity) {
+        // the profiler belongs to the game thread, parallel lanes are only timed as a whole
+        if (profiler == nullptr || lanesInParallel) {
+            entity->tick();
+            return;
+        }
+        queryCaller = profiler->typeName(typeid(*entity));
+        ProfileScope entityScope(profiler, queryCaller, true);
+        entity->tick();
+        queryCaller = "Game";
+    }
+
+    void profilePhase(const char* name) {
+        if (profiler != nullptr)
+            profiler->phase(name);
+    }
+
+    void drawEntities() {
+        if (headless)
+            return;
+        for (Entity* entity : entityCollection) {
+            if (!entity->destroyed)
+                entity->draw();
+        }
+    }
+
     bool startGame() {
-        srand(time(NULL));
+        if (headless)
+            return false;
         sf::Clock sleepClock;
 
         sf::Texture fieldTexture;
@@ -599,69 +3495,67 @@ public:
         sf::Text scoreText = generateText(550, 680);
 
         // Update game logic at FRAME_RATE
-        while (gameWindow.isOpen()) {
+        pacer.start(FRAME_RATE);
+        while (gameWindow->isOpen()) {
             sleepClock.restart();
+            if (profiler != nullptr)
+                profiler->beginFrame();
 
             // poll input
+            profilePhase("input");
             sf::Event event;
-            while (gameWindow.pollEvent(event)) {
+            while (gameWindow->pollEvent(event)) {
                 if (event.type == sf::Event::Closed)
-                    gameWindow.close();
-                destroyButton.handleEvent(event, gameWindow);
-                plantButton.handleEvent(event, gameWindow);
-                plant1Button.handleEvent(event, gameWindow);
-                plant2Button.handleEvent(event, gameWindow);
-                plant3Button.handleEvent(event, gameWindow);
-                plant4Button.handleEvent(event, gameWindow);
-                plant5Button.handleEvent(event, gameWindow);
-                plant6Button.handleEvent(event, gameWindow);
+                    gameWindow->close();
+                if (event.type == sf::Event::KeyPressed && profiler != nullptr) {
+                    if (event.key.code == sf::Keyboard::F3)
+                        profiler->overlayVisible = !profiler->overlayVisible;
+                    else if (event.key.code == sf::Keyboard::F4 && profiler->isTracing())
+                        profiler->stopTrace();
+                    else if (event.key.code == sf::Keyboard::F4)
+                        profiler->startTrace("trace.json");
+                }
+                destroyButton.handleEvent(event, *gameWindow);
+                plantButton.handleEvent(event, *gameWindow);
+                plant1Button.handleEvent(event, *gameWindow);
+                plant2Button.handleEvent(event, *gameWindow);
+                plant3Button.handleEvent(event, *gameWindow);
+                plant4Button.handleEvent(event, *gameWindow);
+                plant5Button.handleEvent(event, *gameWindow);
+                plant6Button.handleEvent(event, *gameWindow);
             }
-            mousePos.x = sf::Mouse::getPosition(gameWindow).x * ((float)WINDOW_WIDTH / gameWindow.getSize().x);
-            mousePos.y = sf::Mouse::getPosition(gameWindow).y * ((float)WINDOW_HEIGHT / gameWindow.getSize().y);
+            mousePos.x = sf::Mouse::getPosition(*gameWindow).x * ((float)WINDOW_WIDTH / gameWindow->getSize().x);
+            mousePos.y = sf::Mouse::getPosition(*gameWindow).y * ((float)WINDOW_HEIGHT / gameWindow->getSize().y);
 
-            gameWindow.clear();
+            profilePhase("background");
+            gameWindow->clear();
 
             // draw static elements
-            gameWindow.draw(fieldSprite);
-            gameWindow.draw(barSprite);
+            gameWindow->draw(fieldSprite);
+            gameWindow->draw(barSprite);
 
             if (isGameOver) {
+                // nothing left worth continuing
+                if (autosave != nullptr)
+                    autosave->discard();
+                if (profiler != nullptr) {
+                    profiler->writeQueryReport("query_costs.csv");
+                    profiler->resetQueryCosts();
+                }
                 return false;
             }
 
             // make entities tick
-            for (Entity* entity : entityCollection) {
-                entity->tick();
-            }
+            profilePhase("simulate");
+            simulateTick();
+            profilePhase("draw entities");
+            drawEntities();
 
-            // spöwns a sömbie every tick with 1 zu füfhundert chance.
-            if ((rand() % zombieChance + 1) == zombieChance) {
-                int whichZombieNumber = rand() % 100;
-                // pushing a default skin 75%
-                if (whichZombieNumber <= 75)
-                   spawnZombie(0);
-                else if (whichZombieNumber <= 86 && passedWaves > 0)
-                    spawnZombie(1);
-				else if (whichZombieNumber <= 99 && passedWaves > 0)
-                    if (rand() % 2 == 0)
-					    spawnZombie(2);
-                    else
-                        spawnZombie(3);
-            }
-            waveCount++;
-            // noch einerhalb minute hört wave uf
-            if(waveCount >= 5400) {
-                zombieChance = 200 + passedWaves * 15;
-                waveCount = 0;
-                passedWaves++;
-            // after 1 minute fangt wave aa
-            }else if (waveCount >= 3600) {
-                // double spawn rate
-                zombieChance = 20 + passedWaves;
-            }
-            
+            profilePhase("autosave");
+            autosaveTick();
 
             // editing
+            profilePhase("editing");
             if (sf::Mouse::isButtonPressed(sf::Mouse::Right))
                 editMode = 0;
             if (mousePos.y < gridToFree(GRID_ROWS)) {
@@ -681,55 +3575,126 @@ public:
                 }
             }
 
+            profilePhase("hud");
             bananasCountText.setString("Bananas: " + std::to_string(bananaCount) + "$");
             scoreText.setString("Score: " + std::to_string(score));
 
             // draw static elements
-            gameWindow.draw(bananasCountText);
-            gameWindow.draw(scoreText);
-
-            plantButton.draw(gameWindow);
-            destroyButton.draw(gameWindow);
-            plant1Button.draw(gameWindow);
-            plant2Button.draw(gameWindow);
-            plant3Button.draw(gameWindow);
-            plant4Button.draw(gameWindow);
-            plant5Button.draw(gameWindow);
-            plant6Button.draw(gameWindow);
+            gameWindow->draw(bananasCountText);
+            gameWindow->draw(scoreText);
+
+            plantButton.draw(*gameWindow);
+            destroyButton.draw(*gameWindow);
+            plant1Button.draw(*gameWindow);
+            plant2Button.draw(*gameWindow);
+            plant3Button.draw(*gameWindow);
+            plant4Button.draw(*gameWindow);
+            plant5Button.draw(*gameWindow);
+            plant6Button.draw(*gameWindow);
+
+            if (profiler != nullptr && profiler->overlayVisible) {
+                profilePhase("overlay");
+                profiler->drawOverlay(*gameWindow, font, pacer.summary());
+            }
 
-            gameWindow.display();
+            profilePhase("display");
+            gameWindow->display();
+            if (profiler != nullptr)
+                profiler->endFrame();
+            quality.frameDone(sleepClock.getElapsedTime().asSeconds() * 1000.f, 1000.f / FRAME_RATE, profiler);
 
             // let our thread sleep until dawn of new frame
-            sf::Time remainingTime = sf::Time(sf::seconds(deltaTime())) - sleepClock.getElapsedTime();
-            if (remainingTime > sf::Time::Zero)
-                sf::sleep(remainingTime);
+            pacer.wait();
+        }
+
+        // window got closed mid game: save once more so the session can be continued
+        if (autosave != nullptr) {
+            GameSnapshot* snapshot;
+            while ((snapshot = autosave->acquire()) == nullptr)
+                sf::sleep(sf::milliseconds(1));
+            captureSnapshot(*snapshot);
+            autosave->publish();
         }
         return false;
     }
 };
 
 
+void Entity::ready() {
+    archetype->prewarm(!game->headless);
+    group = archetype->group;
+    type = archetype->type;
+    topHealth = archetype->topHealth;
+    health = topHealth;
+    frameDuration = archetype->frameDuration;
+    pauseAnimation = archetype->pauseAnimation;
+
+    sprite.setScale(SCALE, SCALE);
+    showTexture(0);
+    sprite.setOrigin(sprite.getLocalBounds().width * archetype->origin.x, sprite.getLocalBounds().height * archetype->origin.y);
+    if (archetype->clip == CLIP_TIMED && archetype->frameCount > 1)
+        animate();
+}
+
+// looping clips don't need a timer per entity, the frame follows from the game clock
+int Entity::animationFrame() const {
+    if (archetype->clip != CLIP_LOOP || pauseAnimation || archetype->frameCount < 2)
+        return currentFrame;
+    return game->tickCount / game->secondsToTicks(frameDuration) % archetype->frameCount;
+}
+
+// pixel precise, with this standing at position at and other at otherAt; kinds without a mask count as touching
+bool Entity::touches(sf::Vector2f at, const Entity& other, sf::Vector2f otherAt) const {
+    const AlphaMask* mask = archetype->mask(animationFrame());
+    const AlphaMask* otherMask = other.archetype->mask(other.animationFrame());
+    if (mask == nullptr || otherMask == nullptr)
+        return true;
+    // sprites are drawn from their top left corner, origin (texture pixels) before it
+    float left = at.x - archetype->origin.x * mask->width * SCALE;
+    float top = at.y - archetype->origin.y * mask->height * SCALE;
+    float otherLeft = otherAt.x - other.archetype->origin.x * otherMask->width * SCALE;
+    float otherTop = otherAt.y - other.archetype->origin.y * otherMask->height * SCALE;
+    return mask->overlaps(*otherMask, (int)std::lround((otherLeft - left) / SCALE), (int)std::lround((otherTop - top) / SCALE));
+}
+
+void Entity::animate() {
+    game->schedule(this, game->secondsToTicks(frameDuration), [this] {
+        nextAnimationFrame();
+        animate();
+    });
+}
+
 void Entity::tick() {
     x += xVel * game->deltaTime();
     y += yVel * game->deltaTime();
+}
+
+void Entity::draw() {
+    if (game->headless)
+        return;
+    // when frames get slow only the ones around the mouse keep animating
+    const int focus = 3 * game->GRID_SPACE;
+    if (game->quality.animateEverywhere() || (std::abs(x - game->mousePos.x) < focus && std::abs(y - game->mousePos.y) < focus))
+        showTexture(animationFrame());
+    // entities that don't tick never move, so the sprite is placed here
     sprite.setPosition(x, y);
-    updateAnimation(game->deltaTime());
-    game->gameWindow.draw(sprite);
+    game->gameWindow->draw(sprite);
 
-    if (health < topHealth) {
+    if (health < topHealth && game->quality.healthLabels()) {
         sf::Text healthText;
         healthText.setFont(game->font);
         healthText.setString(std::to_string((int)health));
         healthText.setCharacterSize(13);
         healthText.setPosition(x, y + 20.f);
-        game->gameWindow.draw(healthText);
+        game->gameWindow->draw(healthText);
     }
 }
 
 bool Entity::damage(float d) {
     health -= d;
+    onHealthChanged();
     if (health <= 0) {
-        game->destroyEntity(id);
+        game->destroyEntity(this);
         return true;
     }
     return false;
@@ -751,10 +3716,10 @@ class Zombie : public Entity {
 protected:
     float knockback = 0.f;
     int startingGridRow = 1;
-    float xVelNormal = -100.f;
-    float damageDonePerSec = 35.f;
     int scorePoints = 10;
-    int walkingAnimationCounter = 0;
+    int spawnTick = 0;          // the wobble starts from here
+    bool wobbles = true;
+    float appliedTilt = 0.f;    // what the sprite got last, getRotation() hands -10 back as 350
     int spawnChance = 200;
 
 public:
@@ -763,24 +3728,24 @@ public:
         return scorePoints;
     }
 
-    Zombie(int startingGridRow) : startingGridRow(startingGridRow) {}
+    Zombie(int startingGridRow, const Archetype& archetype = ARCHETYPES[KIND_ZOMBIE])
+        : Entity(archetype), startingGridRow(startingGridRow) {
+        lane = startingGridRow;
+    }
 
     void ready() override {
-        resDir = "woodchopper";
-        // Call Entity's ready after setting the ressources directory
+        // Call Entity's ready first, it sets up health and textures from the archetype
         Entity::ready();
 
-        group = "zombie";
-        sprite.setScale(100/32, 100/32);
-        sprite.setOrigin(sprite.getLocalBounds().width / 2.f, sprite.getLocalBounds().height / 2.f);
-
         y = game->gridToFree(startingGridRow);
         x = game->WINDOW_WIDTH;
-        xVel = xVelNormal;
+        xVel = archetype->speed;
+        spawnTick = game->tickCount;
     }
 
     bool damage(float d) override {
         knockback += d / 2;
+        game->zombieMoved(this);
 
         // Call Parent's (Entity's) base implementation
         return Entity::damage(d);
@@ -788,190 +3753,312 @@ public:
 
     void tick() override {
         // mhhh yummieyum.. let me see if theres a plant i can take a bite off 🧟
+        float xVelBefore = xVel;
         if (game->hasGridCollision(getGridPos(), "plant")) {
             xVel = 0.f;
             // attack 2 targets max
             std::vector<Entity*> collisions = game->getGridCollisions(getGridPos(), "plant");
-            collisions[0]->damage(damageDonePerSec * game->deltaTime());
+            game->damageEntity(collisions[0], archetype->damage * game->deltaTime());
             if (collisions.size() > 1)
-                collisions[1]->damage(damageDonePerSec * game->deltaTime());
+                game->damageEntity(collisions[1], archetype->damage * game->deltaTime());
         } else {
-            xVel = xVelNormal;
+            xVel = archetype->speed;
         }
+        // projectiles in the row assume it keeps its pace
+        if (xVel != xVelBefore || knockback > 0.f)
+            game->zombieMoved(this);
 
         x += knockback;
         if (knockback > 0.f)
             knockback -= game->deltaTime() * 15.f;
 
-        if(walkingAnimationCounter == 40) {
-            sprite.setRotation(-10.f);
-        
-        }
-
-        if(walkingAnimationCounter == 80) {
-            sprite.setRotation(10.f);
-            walkingAnimationCounter = 0;
-        
-        }
-        walkingAnimationCounter++;
         if (getGridPos().x < 0) {
-            game->isGameOver = true;
+            game->setGameOver();
         }
         // Always call Entity's tick
         Entity::tick();
     }
 
+    void draw() override {
+        // straight for the first 40 ticks, then tilting every 40 ticks; nothing to do for it while ticking
+        if (wobbles) {
+            int age = game->tickCount - spawnTick;
+            float tilt = age < 40 || !game->quality.wobble() ? 0.f : (age % 80 < 40 ? 10.f : -10.f);
+            if (tilt != appliedTilt) {
+                sprite.setRotation(tilt);
+                appliedTilt = tilt;
+            }
+        }
+        Entity::draw();
+    }
+
     // Zombie specific functions
     int getGridRow() const { return game->freeToGrid(x); }
+    // px per second to the right, as long as it isn't knocked back any further and keeps walking or eating
+    float pace() const { return xVel + std::min(knockback, 0.f) * game->FRAME_RATE; }
     float getProgressLocation() const { return game->WINDOW_WIDTH - x; }
 };
 
 class TankZombie : public Zombie {
 public:
-    TankZombie(int startingRow) : Zombie(startingRow) {}
-    void ready() override {
-        resDir = "tank_woodchopper";
-        Entity::ready();
-
-        topHealth = 500;
-        health = topHealth;
-        xVelNormal = -50.f;
-        xVel = xVelNormal;
-        group = "zombie";
-        sprite.setScale(100 / 32, 100 / 32);
-        sprite.setOrigin(sprite.getLocalBounds().width / 2.f, sprite.getLocalBounds().height / 2.f);
-        y = game->gridToFree(startingGridRow);
-        x = game->WINDOW_WIDTH;
-    }
+    TankZombie(int startingRow) : Zombie(startingRow, ARCHETYPES[KIND_TANK_ZOMBIE]) {}
 
     bool damage(float d) override {
         knockback += d / 5;
+        game->zombieMoved(this);
         return Entity::damage(d);
     }
 };
 
 class ChainsawZombie : public Zombie {
 public:
-    ChainsawZombie(int startingRow) : Zombie(startingRow) {}
-    void ready() override {
-        resDir = "chainsaw_carrier";
-        Entity::ready();
-
-        topHealth = 100;
-        health = topHealth;
-        xVelNormal = -100.f;
-        xVel = xVelNormal;
-		damageDonePerSec = 175.f;
-        group = "zombie";
-        sprite.setScale(100 / 32, 100 / 32);
-        sprite.setOrigin(sprite.getLocalBounds().width / 2.f, sprite.getLocalBounds().height / 2.f);
-        y = game->gridToFree(startingGridRow);
-        x = game->WINDOW_WIDTH;
-    }
-	void tick() override {
-		if(walkingAnimationCounter % 20 == 0) {
-			sprite.setTexture(textures[0]);
-		}
-		if(walkingAnimationCounter % 20 == 10) {
-			sprite.setTexture(textures[1]);
-		}
-		Zombie::tick();
-	}
+    ChainsawZombie(int startingRow) : Zombie(startingRow, ARCHETYPES[KIND_CHAINSAW_ZOMBIE]) {}
     bool damage(float d) override {
         knockback += d / 5;
+        game->zombieMoved(this);
         return Entity::damage(d);
     }
 };
 
 class BulldozerZombie : public Zombie {
 public:
-    BulldozerZombie(int startingRow) : Zombie(startingRow) {}
-    void ready() override {
-        resDir = "bulldozer";
-        Entity::ready();
+    BulldozerZombie(int startingRow) : Zombie(startingRow, ARCHETYPES[KIND_BULLDOZER]) {
+        wobbles = false;
+    }
+};
+
+// c[0] + c[1] t + ... + c[degree] t^degree
+double evalPolynomial(const double* c, int degree, double t) {
+    double value = 0;
+    for (int i = degree; i >= 0; i--)
+        value = value * t + c[i];
+    return value;
+}
+
+// real roots in [lo, hi], ascending; returns how many (degree 4 at most)
+// between two roots of the derivative it only goes one way, so a sign change there is one root, bisected
+int polynomialRoots(const double* c, int degree, double lo, double hi, double* roots) {
+    while (degree > 0 && c[degree] == 0)
+        degree--;
+    if (degree == 0)
+        return 0;
+
+    double bounds[6] = { lo };
+    int count = 1;
+    if (degree > 1) {
+        double derivative[4];
+        for (int i = 1; i <= degree; i++)
+            derivative[i - 1] = c[i] * i;
+        count += polynomialRoots(derivative, degree - 1, lo, hi, bounds + 1);
+    }
+    bounds[count++] = hi;
+
+    int found = 0;
+    for (int k = 1; k < count; k++) {
+        double left = bounds[k - 1], right = bounds[k];
+        double leftValue = evalPolynomial(c, degree, left);
+        if ((leftValue > 0) == (evalPolynomial(c, degree, right) > 0))
+            continue;
+        for (int i = 0; i < 40; i++) {
+            double middle = (left + right) / 2;
+            if ((evalPolynomial(c, degree, middle) > 0) == (leftValue > 0))
+                left = middle;
+            else
+                right = middle;
+        }
+        roots[found++] = right;
+    }
+    return found;
+}
 
-        topHealth = 200;
-        health = topHealth;
-        xVelNormal = -50.f;
-        xVel = xVelNormal;
-		damageDonePerSec = 300.f;
-        group = "zombie";
-        sprite.setScale(100 / 32, 100 / 32);
-        y = game->gridToFree(startingGridRow);
-        x = game->WINDOW_WIDTH;
+// first t in [lo, hi] where the polynomial is <= 0, or -1
+double firstNonPositive(const double* c, int degree, double lo, double hi) {
+    if (evalPolynomial(c, degree, lo) <= 0)
+        return lo;
+    double roots[4];
+    double first = polynomialRoots(c, degree, lo, hi, roots) > 0 ? roots[0] : -1;
+    // it can also just touch zero where it turns around
+    double derivative[4];
+    for (int i = 1; i <= degree; i++)
+        derivative[i - 1] = c[i] * i;
+    int turns = polynomialRoots(derivative, degree - 1, lo, hi, roots);
+    for (int i = 0; i < turns && (first < 0 || roots[i] < first); i++) {
+        if (evalPolynomial(c, degree, roots[i]) <= 0)
+            return roots[i];
     }
-	void tick() override {
-        walkingAnimationCounter = 0;
-		Zombie::tick();
-	}
-};
+    return first;
+}
 
+/*
+Thrown along its row, slowing down by DRAG and falling with gravityMultiplier. That is a closed formula of the time
+since launch, so instead of looking for zombies every tick it works out when it will first touch one (aim()) and
+does the hit on a timer. Whenever zombies of the row enter, leave or change their pace it looks at just those
+(Game::watchLane()), so it hits exactly when the circles first overlap, even between two ticks.
+The circle is only the broadphase: from there on the sprites' alpha masks have to touch (Entity::touches()).
+*/
 class Projectile : public Entity {
 protected:
+    static constexpr float DRAG = 200.f;
+    static constexpr float HIT_RADIUS = 25.f;
     float lifeSpan = 1.0f;
-    int damageDone = 15;
-    float baseVelocity = 1000.f;
     float gravityMultiplier = 200.f;
+    float throwHeight = 20.f;
 
     GridPos initGridPos;
-    float lifeTimer = 0.f;
+
+    // where it was thrown from and when (moved by Game::restore())
+    int launchTick = 0;
+    float launchX = 0, launchY = 0, launchXVel = 0, launchYVel = 0;
+    int expireTick = 0;
+    TimerHandle hitTimer;
+    int hitTick = -1;               // when hitTimer fires, -1: no hit planned
+    std::vector<int> targetIds;     // the zombies it hits then, by id: they may be buried before
 
 public:
-    Projectile(GridPos gridPos) : initGridPos(gridPos) {}
+    // flies along the row of the plant that threw it
+    Projectile(GridPos gridPos, const Archetype& archetype = ARCHETYPES[KIND_STONE])
+        : Entity(archetype), initGridPos(gridPos) {
+        lane = gridPos.y;
+    }
 
     void ready() override {
-        resDir = "stone";
-        sprite.setScale(100/32, 100/32);
         Entity::ready();
-        group = "projectile";
 
         x = game->gridToFree(initGridPos.x);
-        y = game->gridToFree(initGridPos.y) - 20.f;
-        xVel = baseVelocity;
+        y = game->gridToFree(initGridPos.y) - throwHeight;
+        xVel = archetype->speed;
+        launch();
+        expire();
+        game->watchLane(this, [this](const std::vector<Entity*>& moved, const std::vector<int>& left) { aim(moved, left); });
+    }
+
+    void onRestored() override {
+        launch();
+    }
+
+    void launch() {
+        launchTick = game->settledTick();
+        launchX = x;
+        launchY = y;
+        launchXVel = xVel;
+        launchYVel = yVel;
+    }
+
+    // it still flies (and hits) during the tick it expires in
+    void expire() {
+        expireTick = game->settledTick() + 1 + game->secondsToTicks(lifeSpan);
+        game->scheduleAt(this, expireTick, [this] { game->destroyEntity(this); });
+    }
+
+    // ticks since launch, can be a fraction
+    void moveTo(double t) {
+        double seconds = t / game->FRAME_RATE;
+        x = launchX + launchXVel * seconds - DRAG / 2 * seconds * seconds;
+        y = launchY + launchYVel * seconds + gravityMultiplier / 2 * seconds * seconds;
+        xVel = launchXVel - DRAG * seconds;
+        yVel = launchYVel + gravityMultiplier * seconds;
     }
 
     void tick() override {
-        // imitate physics
-        xVel -= game->deltaTime() * 200;
-        yVel += game->deltaTime() * gravityMultiplier;
-
-        lifeTimer += game->deltaTime();
-        if (lifeTimer >= lifeSpan)
-            game->destroyEntity(id);
-
-        // check for colliding zombies; damage & destroy self
-        std::vector<Entity*> hits = game->getCollisions(x, y, 25.f, "zombie");
-        for (Entity* zombie : hits) {
-            bool isZombieDead = zombie->damage(damageDone);
-            if (isZombieDead) {
-                Zombie* realZombie = dynamic_cast<Zombie*>(zombie);
-                game->score += realZombie->getScorePoints();
+        moveTo(game->tickCount - launchTick);
+    }
+
+    // ticks from now until it first touches zombie, or -1 if that's not within horizon ticks
+    double contactIn(const Zombie* zombie, double horizon) {
+        double seconds = (game->settledTick() - launchTick) / game->FRAME_RATE;
+        double dt = 1.0 / game->FRAME_RATE;
+        // cheap test first: it only flies right, so both have to pass through the same stretch of x
+        double reach = horizon * dt;
+        double zombieFrom = zombie->x + std::min(0.0, zombie->pace() * reach) - HIT_RADIUS;
+        double zombieTo = zombie->x + std::max(0.0, zombie->pace() * reach) + HIT_RADIUS;
+        double farthest = launchX + launchXVel * (seconds + reach) - DRAG / 2 * (seconds + reach) * (seconds + reach);
+        if (zombieTo < x || zombieFrom > farthest)
+            return -1;
+
+        // distance to the zombie's origin per axis, as c0 + c1 t + c2 t^2 with t in ticks from now
+        double dx[3] = { launchX + launchXVel * seconds - DRAG / 2 * seconds * seconds - zombie->x,
+                         (launchXVel - DRAG * seconds - zombie->pace()) * dt,
+                         -DRAG / 2 * dt * dt };
+        double dy[3] = { launchY + launchYVel * seconds + gravityMultiplier / 2 * seconds * seconds - zombie->y,
+                         (launchYVel + gravityMultiplier * seconds) * dt,
+                         gravityMultiplier / 2 * dt * dt };
+        double c[5] = {
+            dx[0] * dx[0] + dy[0] * dy[0] - HIT_RADIUS * HIT_RADIUS,
+            2 * (dx[0] * dx[1] + dy[0] * dy[1]),
+            dx[1] * dx[1] + 2 * dx[0] * dx[2] + dy[1] * dy[1] + 2 * dy[0] * dy[2],
+            2 * (dx[1] * dx[2] + dy[1] * dy[2]),
+            dx[2] * dx[2] + dy[2] * dy[2]
+        };
+        // pixel precise from the moment the circles touch, then at every tick as long as they still overlap
+        for (double t = firstNonPositive(c, 4, 0, horizon); t >= 0 && t <= horizon; t = std::floor(t) + 1) {
+            if (t > 0 && std::floor(t) == t && evalPolynomial(c, 4, t) > 0)
+                break;
+            sf::Vector2f at(dx[0] + dx[1] * t + dx[2] * t * t + zombie->x + zombie->pace() * t * dt,
+                            dy[0] + dy[1] * t + dy[2] * t * t + zombie->y);
+            if (touches(at, *zombie, sf::Vector2f(zombie->x + zombie->pace() * t * dt, zombie->y)))
+                return t;
+        }
+        return -1;
+    }
+
+    // keeps the plan unless one of its targets moved or left: then it aims again at the whole row, otherwise it only
+    // checks whether a zombie that moved gets touched earlier. Every zombie first touched in the same tick gets hit.
+    void aim(const std::vector<Entity*>& moved, const std::vector<int>& left) {
+        auto isTarget = [this](int id) { return std::find(targetIds.begin(), targetIds.end(), id) != targetIds.end(); };
+        bool replan = std::any_of(left.begin(), left.end(), isTarget)
+                      || std::any_of(moved.begin(), moved.end(), [&](const Entity* zombie) { return isTarget(zombie->id); });
+        const std::vector<Entity*>& candidates = replan ? game->getLaneZombies(lane) : moved;
+        if (replan) {
+            game->cancelTimer(this, hitTimer);
+            hitTimer = TimerHandle();
+            hitTick = -1;
+            targetIds.clear();
+        }
+
+        int hitIn = hitTick < 0 ? std::numeric_limits<int>::max() : hitTick - game->settledTick();
+        std::vector<int> targets = targetIds;
+        for (Entity* entity : candidates) {
+            const Zombie* zombie = static_cast<const Zombie*>(entity);
+            if (zombie->destroyed)
+                continue;
+            // later than the best so far doesn't matter
+            double contact = contactIn(zombie, std::min<double>(hitIn, expireTick - game->settledTick()));
+            if (contact < 0)
+                continue;
+            // the tick that moves it past the contact point
+            int ticks = std::max(1, (int)std::ceil(contact));
+            if (ticks < hitIn) {
+                hitIn = ticks;
+                targets.clear();
             }
-            game->destroyEntity(id);
+            if (ticks == hitIn)
+                targets.push_back(zombie->id);
         }
+        if (targets == targetIds)
+            return;
 
-        Entity::tick();
+        // damage & destroy self (score counts if the hit kills)
+        game->cancelTimer(this, hitTimer);
+        targetIds = targets;
+        hitTick = game->settledTick() + hitIn;
+        hitTimer = game->scheduleAt(this, hitTick, [this] {
+            for (int id : targetIds) {
+                if (Zombie* zombie = static_cast<Zombie*>(game->findLaneZombie(lane, id)))
+                    game->damageEntity(zombie, archetype->damage, zombie->getScorePoints());
+            }
+            game->destroyEntity(this);
+        });
     }
 };
 
 class ProjectileHeavy : public Projectile {
 public:
-    ProjectileHeavy(GridPos gridPos) : Projectile(gridPos) {}
-
-    void ready() override {
-        baseVelocity = 1000.f;
+    // thrown upwards, flies longer
+    ProjectileHeavy(GridPos gridPos) : Projectile(gridPos, ARCHETYPES[KIND_ROCK]) {
         yVel = -200.f;
         lifeSpan = 1.7f;
         gravityMultiplier = 300.f;
-        damageDone = 30.f;
-
-        resDir = "rock";
-        sprite.setScale(100/32, 100/32);
-        Entity::ready();
-        group = "projectile";
-        x = game->gridToFree(initGridPos.x);
-        y = game->gridToFree(initGridPos.y) - 10.f;
-        xVel = baseVelocity;
+        throwHeight = 10.f;
     }
 };
 
@@ -979,38 +4066,41 @@ public:
 class Plant : public Entity {
 protected:
     float attackSpeed = 2.0f;
-    float attackTimer = 0.f;
 
     GridPos initGridPos;
 
+    // what every plant's ready() starts with
+    void plant() {
+        Entity::ready();
+        setGridPos(initGridPos);
+        needsTick = false;
+    }
+
 public:
-    int price = 1;
-    Plant(GridPos gridPos) : initGridPos(gridPos) {}
+    Plant(GridPos gridPos, const Archetype& archetype = ARCHETYPES[KIND_PLANT]) : Entity(archetype), initGridPos(gridPos) {
+        lane = gridPos.y;
+    }
 
     void ready() override {
-        resDir = "monkey";
-        sprite.setScale(100/32, 100/32);
-        Entity::ready();
-        price = 3;
-        group = "plant";
-        setGridPos(initGridPos);
+        plant();
+        startAttacking();
     }
 
-    void tick() override {
-        attackTimer += game->deltaTime();
-        bool isReady;
+    // plants stand still, they only wake up for their timers
+    void startAttacking() {
+        needsTick = false;
+        game->schedule(this, game->secondsToTicks(attackSpeed), [this] { attack(); });
+    }
 
-        if (attackTimer >= attackSpeed) {
-            isReady = true;
-            attackTimer = 0.f;
+    void attack() {
+        // nobody in this row: no more timers until a zombie walks in, then look right away
+        if (!game->isLaneActive(lane)) {
+            game->sleepUntilLaneWakes(this, [this] { attack(); });
+            return;
         }
-
-        if (isReady && game->hasZombieOnRowBefore(this->getGridPos())){
+        if (game->hasZombieOnRowBefore(this->getGridPos()))
             makeNewProjectile();
-            isReady = false;
-        }
-
-        Entity::tick();
+        startAttacking();
     }
 
     virtual void makeNewProjectile() {
@@ -1024,32 +4114,36 @@ private:
     float productionDelay = 5.f;
     float productionTimer = 0.f;
     int productionAmount = 1.f;
+    static const int TREE_CHECKS = 5; // per banana
 
 public:
-    ProductionPlant(GridPos gridPos) : Plant(gridPos) {}
+    // looks for trees in the rows above and below
+    ProductionPlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_PRODUCTION_PLANT]) {
+        lane = -1;
+    }
 
     void ready() override {
-        resDir = "prod_monkey";
-        sprite.setScale(100/32, 100/32);
-        Entity::ready();
-        frameDuration = 2.f;
-        group = "plant";
-        price = 5;
-        setGridPos(initGridPos);
+        plant();
+        productionDelay = game->balance.productionDelay;
+        produce();
     }
 
-    void tick() override {
-        if (isTreeAround()) {
-            productionTimer += game->deltaTime();
-            pauseAnimation = false;
-            if (productionTimer >= productionDelay) {
-                game->bananaCount += productionAmount;
-                productionTimer = 0.f;
+    // only time next to a tree counts, checked a few times per banana instead of every frame
+    void produce() {
+        float checkInterval = productionDelay / TREE_CHECKS;
+        game->schedule(this, game->secondsToTicks(checkInterval), [this, checkInterval] {
+            if (isTreeAround()) {
+                productionTimer += checkInterval;
+                pauseAnimation = false;
+                if (productionTimer >= productionDelay - checkInterval / 2) {
+                    game->addBananas(productionAmount);
+                    productionTimer = 0.f;
+                }
+            } else {
+                pauseAnimation = true;
             }
-        } else {
-            pauseAnimation = true;
-        }
-        Entity::tick();
+            produce();
+        });
     }
 
     bool isTreeAround() {
@@ -1064,71 +4158,50 @@ public:
 
 class TreePlant : public Plant{
 public:
-    TreePlant(GridPos gridPos) : Plant(gridPos) {}
+    TreePlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_TREE]) {}
     void ready() override {
-        resDir = "tree";
-        sprite.setScale(100 / 32, 100 / 32);
-        Entity::ready();
-        type = "tree";
-        price = 1;
-        group = "plant";
-        setGridPos(initGridPos);
-    }
-    void tick() override {
-        Entity::tick();
+        plant();
     }
 };
 
 class TankPlant : public Plant {
 
 public:
-    TankPlant(GridPos gridPos) : Plant(gridPos) {}
+    TankPlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_TANK_PLANT]) {}
 
     void ready() override {
-        resDir = "tank_monkey";
-        pauseAnimation = true;
-        sprite.setScale(100/32, 100/32);
-        Entity::ready();
-        price = 4;
-        topHealth = 1000;
-        health = topHealth;
-        group = "plant";
-        setGridPos(initGridPos);
+        plant();
     }
 
-    void tick() override {
-        sprite.setTexture(textures[0]);
-        if (health <= 666)
-            sprite.setTexture(textures[1]);
-        if (health <= 333)
-            sprite.setTexture(textures[2]);
-        Entity::tick();
+    void onHealthChanged() override {
+        showTexture(health <= 333 ? 2 : (health <= 666 ? 1 : 0));
     }
 };
 
 class MendingPlant : public Plant {
 private:
     Entity* target = nullptr;
+    int targetId = -1;
     float healingSpeed = 0.5f;
     float healthPerAppointment = 30.f;
     float healthOverload = 20.f;
 
     float healthDelt = 0;
     float movementSpeed = 100.f;
-    float idleTimer = 2.f;
+    float searchInterval = 0.5f;   // seconds between looking for patients when nobody is hurt
 
     Entity* findTarget() {
         std::vector<Entity*> entitiesShuffled = game->entityCollection;
-        std::random_device rd;
-        std::mt19937 randomEngine(rd());
-        std::shuffle(entitiesShuffled.begin(), entitiesShuffled.end(), randomEngine);
+        std::shuffle(entitiesShuffled.begin(), entitiesShuffled.end(), game->rng);
 
         for (Entity* test : entitiesShuffled) {
-            if (test->group == "plant" && test->health < test->topHealth && test != this) {
-                idleTimer = 2.f + rand() / RAND_MAX;
+            if (test->group == "plant" && test->health < test->topHealth && test != this && !test->destroyed) {
+                rest(2.f + game->randomFloat());
+                targetId = test->id;
                 return test;
             }
         }
+        targetId = -1;
         return nullptr;
     }
 
@@ -1145,13 +4218,14 @@ private:
             xVel = (std::abs(xDiff) <= tolerance) ? 0.f : (xDiff > 0 ? movementSpeed : -movementSpeed);
             yVel = (std::abs(yDiff) <= tolerance) ? 0.f : (yDiff > 0 ? movementSpeed : -movementSpeed);
 
-            sprite.setTexture((xVel >= 0.f) ? textures[0] : textures[1]);
+            showTexture((xVel >= 0.f) ? 0 : 1);
         }
         return false;
     }
 
     bool healTarget() {
         target->health += healingSpeed;
+        target->onHealthChanged();
         healthDelt += healingSpeed;
 
         if (healthDelt >= healthPerAppointment || target->health >= target->topHealth + healthOverload) {
@@ -1160,31 +4234,39 @@ private:
         }
         return false;
     }
+
+    // no ticks until the timer wakes it up again
+    void rest(float seconds) {
+        xVel = 0.f;
+        yVel = 0.f;
+        needsTick = false;
+        game->schedule(this, game->secondsToTicks(seconds), [this] { needsTick = true; });
+    }
 public:
-    MendingPlant(GridPos gridPos) : Plant(gridPos) {}
+    MendingPlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_MENDING_PLANT]) {
+        lane = -1;
+    }
 
     void ready() override {
-        resDir = "med_monkey";
-        sprite.setScale(100 / 32, 100 / 32);
-        Entity::ready();
-        pauseAnimation = true;
-        price = 10;
-        group = "plant";
-        setGridPos(initGridPos);
+        plant();
+        rest(2.f);
     }
 
     void tick() override {
-        if (idleTimer < 0.f) {
-            if (target == nullptr) {
-                target = findTarget();
-            } else {
-                if (moveToTarget())
-                    if(healTarget())
-                        target = findTarget();
-            }
+        // the patient might have been destroyed since the last tick
+        if (target != nullptr)
+            target = game->findEntity(targetId);
+
+        if (target == nullptr) {
+            target = findTarget();
         } else {
-            idleTimer -= game->deltaTime();
+            if (moveToTarget())
+                if(healTarget())
+                    target = findTarget();
         }
+        // findTarget() already put it to rest when it found someone
+        if (target == nullptr && needsTick)
+            rest(searchInterval);
 
         Entity::tick();
     }
@@ -1193,49 +4275,34 @@ public:
 class BombPlant : public Plant{
 public:
     bool detonated = false;
-    BombPlant(GridPos gridPos) : Plant(gridPos) {}
-    void ready() override {
-        resDir = "bomb";
-        pauseAnimation = true;
-        frameDuration = 0.1f;
-        sprite.setOrigin(32.f, 32.f);
-        sprite.setScale(100 / 32, 100 / 32);
-        Entity::ready();
-        price = 5;
-        group = "plant";
-        setGridPos(initGridPos);
+    // the blast reaches the rows above and below
+    BombPlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_BOMB]) {
+        lane = -1;
     }
-    void tick() override {
-        Entity::tick();
+    void ready() override {
+        plant();
     }
     bool damage(float d) override {
         pauseAnimation = false;
         return Entity::damage(d);
     }
-    void updateAnimation(float dt) override {
-        Entity::updateAnimation(dt);
+    void nextAnimationFrame() override {
+        Entity::nextAnimationFrame();
         if (currentFrame == 2) {
+            // 200 for every tick the blast frame is shown, like when this was checked every tick
             for (Entity* victim : game->getGridCollisionsAround(getGridPos(), "zombie"))
-                victim->damage(200.f);
+                game->damageEntity(victim, 200.f * game->secondsToTicks(frameDuration));
             detonated = true;
         }
         if (currentFrame == 0 && detonated) {
-            game->destroyEntity(id);
+            game->destroyEntity(this);
         }
     }
 };
 
 class HeavyPlant : public Plant {
 public:
-    HeavyPlant(GridPos gridPos) : Plant(gridPos) {}
-    void ready() override {
-        resDir = "heavy_monkey";
-        sprite.setScale(100/32, 100/32);
-        Entity::ready();
-        price = 20;
-        group = "plant";
-        setGridPos(initGridPos);
-    }
+    HeavyPlant(GridPos gridPos) : Plant(gridPos, ARCHETYPES[KIND_HEAVY_PLANT]) {}
     void makeNewProjectile() override {
         ProjectileHeavy* projectile = new ProjectileHeavy(this->getGridPos());
         game->createEntity(projectile);
@@ -1243,77 +4310,860 @@ public:
 };
 
 
-int Game::placePlant() {
-  GridPos gridPos(freeToGrid(mousePos.x), freeToGrid(mousePos.y));
-  if (!hasGridCollision(gridPos, "plant")) {
-      Plant* plant;
-      switch (selectedPlant) {
-        case 0:
-            plant = new Plant(gridPos);
-            break;
-        case 1:
-            plant = new ProductionPlant(gridPos);
-            break;
-        case 2:
-            plant = new TankPlant(gridPos);
-            break;
-        case 3:
-            plant = new MendingPlant(gridPos);
-            break;
-        case 4:
-            plant = new TreePlant(gridPos);
-            break;
-        case 5:
-            plant = new BombPlant(gridPos);
-            break;
-        case 6:
-            plant = new HeavyPlant(gridPos);
-            break;
-        default:
-            plant = new Plant(gridPos);
-            break;
-      }
-      createEntity(plant);
-      return plant->price;
-  }
-  return 0;
+/*
+One row per EntityKind, in that order 🧬
+resDir, group, type, make, topHealth, speed, damage, frameDuration, pauseAnimation, clip, origin
+*/
+const Archetype ARCHETYPES[ENTITY_KIND_COUNT] = {
+    { "woodchopper", "zombie", "entity", [](GridPos p) -> Entity* { return new Zombie(p.y); },
+      100.f, -100.f, 35.f, 0.2f, false, CLIP_LOOP, { 0.5f, 0.5f } },
+    { "tank_woodchopper", "zombie", "entity", [](GridPos p) -> Entity* { return new TankZombie(p.y); },
+      500.f, -50.f, 35.f, 0.2f, false, CLIP_LOOP, { 0.5f, 0.5f } },
+    { "chainsaw_carrier", "zombie", "entity", [](GridPos p) -> Entity* { return new ChainsawZombie(p.y); },
+      100.f, -100.f, 175.f, 1.f / 6.f, false, CLIP_LOOP, { 0.5f, 0.5f } },
+    { "bulldozer", "zombie", "entity", [](GridPos p) -> Entity* { return new BulldozerZombie(p.y); },
+      200.f, -50.f, 300.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+
+    { "stone", "projectile", "entity", [](GridPos p) -> Entity* { return new Projectile(p); },
+      100.f, 1000.f, 15.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+    { "rock", "projectile", "entity", [](GridPos p) -> Entity* { return new ProjectileHeavy(p); },
+      100.f, 1000.f, 30.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+
+    { "monkey", "plant", "entity", [](GridPos p) -> Entity* { return new Plant(p); },
+      100.f, 0.f, 0.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+    { "prod_monkey", "plant", "entity", [](GridPos p) -> Entity* { return new ProductionPlant(p); },
+      100.f, 0.f, 0.f, 2.f, false, CLIP_LOOP, { 0.f, 0.f } },
+    { "tank_monkey", "plant", "entity", [](GridPos p) -> Entity* { return new TankPlant(p); },
+      1000.f, 0.f, 0.f, 0.2f, false, CLIP_STILL, { 0.f, 0.f } },
+    { "med_monkey", "plant", "entity", [](GridPos p) -> Entity* { return new MendingPlant(p); },
+      100.f, 0.f, 0.f, 0.2f, false, CLIP_STILL, { 0.f, 0.f } },
+    { "tree", "plant", "tree", [](GridPos p) -> Entity* { return new TreePlant(p); },
+      100.f, 0.f, 0.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+    { "bomb", "plant", "entity", [](GridPos p) -> Entity* { return new BombPlant(p); },
+      100.f, 0.f, 0.f, 0.1f, true, CLIP_TIMED, { 1.f / 3.f, 1.f / 3.f } },
+    { "heavy_monkey", "plant", "entity", [](GridPos p) -> Entity* { return new HeavyPlant(p); },
+      100.f, 0.f, 0.f, 0.2f, false, CLIP_LOOP, { 0.f, 0.f } },
+};
+
+// indexed like Game::selectedPlant
+const EntityKind PLANT_KINDS[7] = {
+    KIND_PLANT, KIND_PRODUCTION_PLANT, KIND_TANK_PLANT, KIND_MENDING_PLANT, KIND_TREE, KIND_BOMB, KIND_HEAVY_PLANT
+};
+
+int Game::placePlant(GridPos gridPos, int plantType) {
+    if (hasGridCollision(gridPos, "plant"))
+        return 0;
+    if (plantType < 0 || plantType >= 7)
+        plantType = 0;
+    createEntity(ARCHETYPES[PLANT_KINDS[plantType]].make(gridPos));
+    return balance.plantPrices[plantType];
 }
 
+// type 0 .. 3 like the first EntityKinds
 void Game::spawnZombie(int type) {
-    Zombie* zombie;
-
-    switch (type) {
-    case 0:
-        zombie = new Zombie(rand() % 8);
-        break;
-    case 1:
-        zombie = new TankZombie(rand() % 8);
-        break;
-    case 2:
-        zombie = new ChainsawZombie(rand() % 8);
-        break;
-    case 3:
-        zombie = new BulldozerZombie(rand() % 8);
-    default:
-        break;
-    }
-
-    createEntity(zombie);  
+    if (type < KIND_ZOMBIE || type > KIND_BULLDOZER)
+        return;
+    createEntity(ARCHETYPES[type].make(GridPos(0, randomInt(GRID_ROWS))));
+}
+
+void Game::restore(const GameSnapshot& snapshot) {
+    bananaCount = snapshot.bananaCount;
+    score = snapshot.score;
+    waveCount = snapshot.waveCount;
+    zombieChance = snapshot.zombieChance;
+    passedWaves = snapshot.passedWaves;
+
+    for (const EntityRecord& record : snapshot.entities) {
+        // nearest row (projectiles fly a bit above theirs), it becomes the entity's lane
+        Entity* entity = ARCHETYPES[record.kind].make(GridPos(freeToGrid(record.x), freeToGrid(record.y + GRID_SPACE / 2)));
+        createEntity(entity);
+        // ready() placed it at its spawn point, put it back where it was
+        entity->x = record.x;
+        entity->y = record.y;
+        entity->xVel = record.xVel;
+        entity->yVel = record.yVel;
+        entity->health = record.health;
+        entity->topHealth = record.topHealth;
+        entity->onHealthChanged();
+        entity->onRestored();
+    }
+}
+
+// ---------------------------- BATCH SIMULATOR ------------------------------
+
+/*
+Plays thousands of headless games on all cores to tune the Balance numbers without playing by hand 🧪
+    app.exe --simulate balance/sweep.txt results.csv
+
+The sweep file has one setting per line, every combination of the listed values is simulated:
+    runs 20                     games per combination (each with its own seed)
+    seed 1                      first seed
+    maxTicks 108000             a run stops here if the jungle survives (30 minutes)
+    sample 600                  banana curve resolution in ticks
+    zombieChance 300 500        Balance values to try...
+    waveStart 3600
+    waveEnd 5400 7200
+    productionDelay 4 5
+    price 1 5 6                 plant type (like Game::selectedPlant) and its prices
+    build eco 0:4@2,3 0:1@1,3   named build order, steps are tick:plantType@gridX,gridY (gridY 0..7)
+
+Build order steps run in order: a step waits until its tick has come and the bananas are there, steps
+for an occupied cell are skipped. Results go to results.csv, the banana curves to results_bananas.csv.
+*/
+struct BuildStep {
+    int tick;
+    int plantType;
+    GridPos gridPos;
+};
+
+struct BuildOrder {
+    std::string name;
+    std::vector<BuildStep> steps;
+};
+
+struct SimulationRun {
+    int id;
+    unsigned seed;
+    Balance balance;
+    const BuildOrder* buildOrder;
+};
+
+struct SimulationResult {
+    int survivalTicks = 0;
+    bool survived = false;
+    int score = 0;
+    int passedWaves = 0;
+    int bananaCount = 0;
+    std::vector<int> bananaCurve;
+};
+
+SimulationResult simulateGame(const SimulationRun& run, int maxTicks, int sampleTicks) {
+    Game game(run.balance, run.seed);
+    SimulationResult result;
+    size_t nextStep = 0;
+    const std::vector<BuildStep>& steps = run.buildOrder->steps;
+
+    while (game.tickCount < maxTicks && !game.isGameOver) {
+        while (nextStep < steps.size() && steps[nextStep].tick <= game.tickCount) {
+            const BuildStep& step = steps[nextStep];
+            if (game.hasGridCollision(step.gridPos, "plant")) {
+                nextStep++;
+                continue;
+            }
+            // save up for it
+            if (game.bananaCount < game.balance.plantPrices[step.plantType])
+                break;
+            game.bananaCount -= game.placePlant(step.gridPos, step.plantType);
+            nextStep++;
+        }
+
+        if (game.tickCount % sampleTicks == 0)
+            result.bananaCurve.push_back(game.bananaCount);
+        game.simulateTick();
+    }
+
+    result.survivalTicks = game.tickCount;
+    result.survived = !game.isGameOver;
+    result.score = game.score;
+    result.passedWaves = game.passedWaves;
+    result.bananaCount = game.bananaCount;
+    return result;
+}
+
+class BalanceSweep {
+public:
+    int runs = 10;
+    unsigned seed = 1;
+    int maxTicks = 108000;
+    int sampleTicks = 600;
+    std::vector<BuildOrder> buildOrders;
+
+    bool load(const std::string& path) {
+        std::ifstream file(path);
+        if (!file) {
+            std::cerr << "Could not open " << path << std::endl;
+            return false;
+        }
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(file, line)) {
+            lineNumber++;
+            line = line.substr(0, line.find('#'));
+            std::istringstream words(line);
+            std::string key;
+            if (!(words >> key))
+                continue;
+            if (!parseSetting(key, words)) {
+                std::cerr << path << ":" << lineNumber << ": cannot read '" << line << "'" << std::endl;
+                return false;
+            }
+        }
+        if (buildOrders.empty())
+            buildOrders.push_back({ "none", {} });
+        return true;
+    }
+
+    // every combination of the listed values, runs times each
+    std::vector<SimulationRun> expand() const {
+        std::vector<Balance> balances(1);
+        auto vary = [&balances](const std::vector<float>& values, std::function<void(Balance&, float)> apply) {
+            if (values.empty())
+                return;
+            std::vector<Balance> varied;
+            for (const Balance& balance : balances) {
+                for (float value : values) {
+                    Balance copy = balance;
+                    apply(copy, value);
+                    varied.push_back(copy);
+                }
+            }
+            balances = varied;
+        };
+        vary(zombieChances, [](Balance& b, float v) { b.zombieChance = (int)v; });
+        vary(waveStarts, [](Balance& b, float v) { b.waveStartTicks = (int)v; });
+        vary(waveEnds, [](Balance& b, float v) { b.waveEndTicks = (int)v; });
+        vary(productionDelays, [](Balance& b, float v) { b.productionDelay = v; });
+        for (int type = 0; type < 7; type++)
+            vary(prices[type], [type](Balance& b, float v) { b.plantPrices[type] = (int)v; });
+
+        std::vector<SimulationRun> expanded;
+        for (const BuildOrder& buildOrder : buildOrders) {
+            for (const Balance& balance : balances) {
+                for (int i = 0; i < runs; i++) {
+                    int id = (int)expanded.size();
+                    expanded.push_back({ id, seed + (unsigned)id, balance, &buildOrder });
+                }
+            }
+        }
+        return expanded;
+    }
+
+private:
+    std::vector<float> zombieChances, waveStarts, waveEnds, productionDelays;
+    std::vector<float> prices[7];
+
+    static bool readValues(std::istringstream& words, std::vector<float>& values) {
+        float value;
+        while (words >> value)
+            values.push_back(value);
+        return !values.empty() && words.eof();
+    }
+
+    bool parseSetting(const std::string& key, std::istringstream& words) {
+        if (key == "runs")
+            return (bool)(words >> runs);
+        if (key == "seed")
+            return (bool)(words >> seed);
+        if (key == "maxTicks")
+            return (bool)(words >> maxTicks);
+        if (key == "sample")
+            return (words >> sampleTicks) && sampleTicks > 0;
+        if (key == "zombieChance")
+            return readValues(words, zombieChances);
+        if (key == "waveStart")
+            return readValues(words, waveStarts);
+        if (key == "waveEnd")
+            return readValues(words, waveEnds);
+        if (key == "productionDelay")
+            return readValues(words, productionDelays);
+        if (key == "price") {
+            int type;
+            return (words >> type) && type >= 0 && type < 7 && readValues(words, prices[type]);
+        }
+        if (key == "build") {
+            BuildOrder buildOrder;
+            if (!(words >> buildOrder.name))
+                return false;
+            std::string step;
+            while (words >> step) {
+                BuildStep parsed = { 0, 0, GridPos(0, 0) };
+                char colon, at, comma;
+                std::istringstream stepWords(step);
+                if (!(stepWords >> parsed.tick >> colon >> parsed.plantType >> at >> parsed.gridPos.x >> comma >> parsed.gridPos.y)
+                    || colon != ':' || at != '@' || comma != ',' || parsed.plantType < 0 || parsed.plantType >= 7)
+                    return false;
+                // a plant off the board would attack along a row that doesn't exist
+                if (parsed.gridPos.x < 0 || parsed.gridPos.y < 0 || parsed.gridPos.y >= Game::GRID_ROWS)
+                    return false;
+                buildOrder.steps.push_back(parsed);
+            }
+            buildOrders.push_back(buildOrder);
+            return true;
+        }
+        return false;
+    }
+};
+
+int runBatchSimulation(const std::string& sweepPath, const std::string& resultPath) {
+    BalanceSweep sweep;
+    if (!sweep.load(sweepPath))
+        return EXIT_FAILURE;
+
+    std::vector<SimulationRun> runs = sweep.expand();
+    std::vector<SimulationResult> results(runs.size());
+    std::atomic<int> finished{0};
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        WorkStealingPool pool;
+        std::cout << "Simulating " << runs.size() << " games on " << pool.size() << " threads" << std::endl;
+        for (const SimulationRun& run : runs) {
+            pool.submit([&run, &results, &finished, &sweep, total = runs.size()] {
+                results[run.id] = simulateGame(run, sweep.maxTicks, sweep.sampleTicks);
+                int done = ++finished;
+                if (done % 100 == 0 || done == (int)total)
+                    std::cout << done << "/" << total << std::endl;
+            });
+        }
+        pool.wait();
+    }
+    float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Done in " << seconds << " s" << std::endl;
+
+    std::ofstream csv(resultPath);
+    csv << "run,seed,build,zombieChance,waveStart,waveEnd,productionDelay";
+    for (int type = 0; type < 7; type++)
+        csv << ",price" << type;
+    csv << ",survivalTicks,survived,score,passedWaves,bananas\n";
+    for (const SimulationRun& run : runs) {
+        const SimulationResult& result = results[run.id];
+        csv << run.id << ',' << run.seed << ',' << run.buildOrder->name << ',' << run.balance.zombieChance << ','
+            << run.balance.waveStartTicks << ',' << run.balance.waveEndTicks << ',' << run.balance.productionDelay;
+        for (int price : run.balance.plantPrices)
+            csv << ',' << price;
+        csv << ',' << result.survivalTicks << ',' << result.survived << ',' << result.score << ','
+            << result.passedWaves << ',' << result.bananaCount << '\n';
+    }
+
+    std::string curvePath = resultPath.substr(0, resultPath.rfind('.')) + "_bananas.csv";
+    std::ofstream curves(curvePath);
+    curves << "run,tick,bananas\n";
+    for (const SimulationRun& run : runs) {
+        const std::vector<int>& curve = results[run.id].bananaCurve;
+        for (size_t i = 0; i < curve.size(); i++)
+            curves << run.id << ',' << i * sweep.sampleTicks << ',' << curve[i] << '\n';
+    }
+
+    if (!csv || !curves) {
+        std::cerr << "Could not write " << resultPath << " or " << curvePath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << resultPath << " and " << curvePath << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------- BENCHMARKS ------------------------------
+
+/*
+Microbenchmarks for the Game query functions plus a few stress scenes ⏱️
+    app.exe --bench [bench.json] [name filter]
+
+Everything runs headless with fixed seeds so two builds can be compared on the same machine (build.sh on Linux).
+Headless games open no window and create no OpenGL context, so it runs on CI machines without a display.
+The JSON uses the same layout as Google Benchmark, so its compare.py can diff two result files:
+    compare.py benchmarks before.json after.json
+*/
+class BenchmarkSuite {
+public:
+    BenchmarkSuite(const std::string& filter) : filter(filter) {}
+
+    // op runs the measured code `iterations` times; the result is ns per iteration
+    void run(const std::string& name, std::function<void(long iterations)> op) {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+
+        // grow the batch until one sample takes ~20 ms so the clock resolution doesn't matter
+        long iterations = 1;
+        while (iterations < (1L << 30)) {
+            double ns = measure(op, iterations);
+            if (ns > 20e6)
+                break;
+            iterations = ns < 1e6 ? iterations * 10 : (long)(iterations * 20e6 / ns) + 1;
+        }
+        recordSamples(name, iterations, [&op, iterations] { return measure(op, iterations); });
+    }
+
+    // for work that can only run a few times (like a tick of a 10k zombie board): time every call on its own
+    void runEach(const std::string& name, int samples, std::function<void()> setup, std::function<void()> op) {
+        if (!filter.empty() && name.find(filter) == std::string::npos)
+            return;
+        setup();
+        recordSamples(name, 1, [&op] {
+            auto start = std::chrono::steady_clock::now();
+            op();
+            return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        }, samples);
+    }
+
+    bool writeJson(const std::string& path) const {
+        std::ofstream json(path);
+        json << "{\n  \"context\": {\n"
+             << "    \"executable\": \"app --bench\",\n"
+             << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n"
+             << "    \"compiler\": \"" << __VERSION__ << "\",\n"
+             << "    \"library_build_type\": \"" << (isOptimizedBuild() ? "release" : "debug") << "\"\n"
+             << "  },\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            json << "    {\"name\": \"" << r.name << "\", \"run_name\": \"" << r.name << "\", \"run_type\": \"iteration\", "
+                 << "\"repetitions\": " << r.samples << ", \"iterations\": " << r.iterations << ", "
+                 << "\"real_time\": " << r.median << ", \"cpu_time\": " << r.median << ", "
+                 << "\"min_time\": " << r.min << ", \"mean_time\": " << r.mean << ", \"time_unit\": \"ns\"}"
+                 << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        json << "  ]\n}\n";
+        return (bool)json;
+    }
+
+private:
+    struct Result {
+        std::string name;
+        long iterations;
+        int samples;
+        double median, min, mean;
+    };
+
+    std::string filter;
+    std::vector<Result> results;
+
+    static bool isOptimizedBuild() {
+#ifdef __OPTIMIZE__
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static double measure(const std::function<void(long)>& op, long iterations) {
+        auto start = std::chrono::steady_clock::now();
+        op(iterations);
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void recordSamples(const std::string& name, long iterations, std::function<double()> sample, int count = 9) {
+        std::vector<double> perOp;
+        for (int i = 0; i < count; i++)
+            perOp.push_back(sample() / iterations);
+        std::sort(perOp.begin(), perOp.end());
+        double sum = 0;
+        for (double ns : perOp)
+            sum += ns;
+        results.push_back({ name, iterations, count, perOp[count / 2], perOp[0], sum / count });
+        std::cout << name << ": " << perOp[count / 2] << " ns (min " << perOp[0] << ", " << iterations << " iterations)" << std::endl;
+    }
+};
+
+// keeps the optimizer from throwing away query results nobody looks at
+volatile size_t benchmarkSink = 0;
+
+// --- scenes, all headless with fixed seeds
+
+// every cell of the 8 rows is taken, zombies come in from the right at x = 1600
+void benchFillBoard(Game& game, const std::vector<int>& plantTypes) {
+    int columns = game.freeToGrid(game.WINDOW_WIDTH) - 1;
+    int n = 0;
+    for (int row = 0; row < game.GRID_ROWS; row++) {
+        for (int column = 0; column < columns; column++)
+            game.placePlant(GridPos(column, row), plantTypes[n++ % plantTypes.size()]);
+    }
+}
+
+void benchAddZombies(Game& game, int count) {
+    for (int i = 0; i < count; i++) {
+        game.spawnZombie(i % 4 == 3 ? game.randomInt(3) + 1 : 0);
+        // spread them over the field instead of stacking them all at the right border
+        game.entityCollection.back()->x = game.WINDOW_WIDTH - game.randomInt(game.WINDOW_WIDTH / 2);
+    }
+}
+
+void benchAddProjectiles(Game& game, int count) {
+    for (int i = 0; i < count; i++) {
+        GridPos from(game.randomInt(game.freeToGrid(game.WINDOW_WIDTH)), game.randomInt(game.GRID_ROWS));
+        if (i % 2 == 0)
+            game.createEntity(new Projectile(from));
+        else
+            game.createEntity(new ProjectileHeavy(from));
+    }
+}
+
+int runBenchmarks(const std::string& jsonPath, const std::string& filter) {
+    BenchmarkSuite suite(filter);
+    Balance balance;
+
+    // a busy late wave: full board, 500 zombies, 300 stones in the air
+    Game game(balance, 1234);
+    benchFillBoard(game, { 0, 6, 4, 1, 2 });
+    benchAddZombies(game, 500);
+    benchAddProjectiles(game, 300);
+    std::vector<std::pair<int, int>> points;
+    for (int i = 0; i < 1024; i++)
+        points.push_back({ game.randomInt(game.WINDOW_WIDTH), game.randomInt(game.GRID_ROWS * game.GRID_SPACE) });
+    auto point = [&points](long i) { return points[i & 1023]; };
+    auto cell = [&game, &point](long i) { return GridPos(game.freeToGrid(point(i).first), game.freeToGrid(point(i).second)); };
+
+    suite.run("query/getCollisions", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.getCollisions(point(i).first, point(i).second, 25.f, "zombie").size();
+    });
+    suite.run("query/getGridCollisions", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.getGridCollisions(cell(i), "plant").size();
+    });
+    suite.run("query/getGridCollisionsAround", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.getGridCollisionsAround(cell(i), "plant").size();
+    });
+    suite.run("query/hasGridCollision", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.hasGridCollision(cell(i), "plant");
+    });
+    suite.run("query/hasZombieOnRowBefore", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.hasZombieOnRowBefore(cell(i));
+    });
+    suite.run("query/findEntity", [&](long n) {
+        for (long i = 0; i < n; i++)
+            benchmarkSink += game.findEntity(game.entityCollection[i % game.entityCollection.size()]->id) != nullptr;
+    });
+    // spawning runs Entity::ready() (headless, so without loading textures)
+    suite.run("entity/spawnZombie", [&](long n) {
+        for (long i = 0; i < n; i++) {
+            game.spawnZombie(0);
+            game.destroyEntity(game.entityCollection.back()->id);
+            game.buryDestroyedEntities();
+        }
+    });
+    suite.run("entity/spawnProjectile", [&](long n) {
+        for (long i = 0; i < n; i++) {
+            game.createEntity(new Projectile(GridPos(3, 3)));
+            game.destroyEntity(game.entityCollection.back()->id);
+            game.buryDestroyedEntities();
+        }
+    });
+
+    // stress scenes: ns per simulateTick()
+    std::unique_ptr<Game> scene;
+    auto tick = [&scene] { scene->simulateTick(); };
+
+    suite.runEach("scene/fullBoard", 60, [&] {
+        scene.reset(new Game(balance, 1));
+        benchFillBoard(*scene, { 0, 6 });
+        benchAddZombies(*scene, 40);
+    }, tick);
+    suite.runEach("scene/zombies10k", 5, [&] {
+        scene.reset(new Game(balance, 2));
+        benchFillBoard(*scene, { 0, 6 });
+        benchAddZombies(*scene, 10000);
+    }, tick);
+    // early wave: 100 plants, 3 zombies, most rows dormant
+    suite.runEach("scene/quietBoard", 60, [&] {
+        scene.reset(new Game(balance, 5));
+        for (int i = 0; i < 100; i++)
+            scene->placePlant(GridPos(i % 13, i / 13), i % 3 == 0 ? 6 : 0);
+        benchAddZombies(*scene, 3);
+        // let the plants in empty rows fall asleep
+        for (int i = 0; i < 150; i++)
+            scene->simulateTick();
+    }, tick);
+    // same scene with the lanes spread over all cores
+    WorkStealingPool pool;
+    suite.runEach("scene/zombies10k/parallel", 5, [&] {
+        scene.reset(new Game(balance, 2));
+        scene->pool = &pool;
+        benchFillBoard(*scene, { 0, 6 });
+        benchAddZombies(*scene, 10000);
+    }, tick);
+    suite.runEach("scene/projectiles5k", 9, [&] {
+        scene.reset(new Game(balance, 3));
+        benchAddZombies(*scene, 200);
+        benchAddProjectiles(*scene, 5000);
+    }, tick);
+    // they have aimed already, only zombies that change their pace make them aim again
+    suite.runEach("scene/projectiles5k/aimed", 9, [&] {
+        scene.reset(new Game(balance, 3));
+        benchAddZombies(*scene, 200);
+        benchAddProjectiles(*scene, 5000);
+        scene->simulateTick();
+    }, tick);
+    suite.runEach("scene/medics", 30, [&] {
+        scene.reset(new Game(balance, 4));
+        benchFillBoard(*scene, { 3, 2 });
+        // give the medics patients
+        for (Entity* entity : scene->entityCollection)
+            entity->health = entity->topHealth / 2;
+        benchAddZombies(*scene, 100);
+    }, tick);
+    scene.reset();
+
+    if (!suite.writeJson(jsonPath)) {
+        std::cerr << "Could not write " << jsonPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote " << jsonPath << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------- LOAD TEST ------------------------------
+
+/*
+Many players at once against create.php and read.php, to see how the score API holds up when a wave of games ends 📈
+    app.exe --loadtest http://localhost/score/ [clients 32] [seconds 30] [submit percent 20]
+
+Never point it at the real server, every submit stores a score named "loadtest".
+Each client sends its next request as soon as the last one is answered: a submit of one random score like the journal
+sends it, or a read of a leaderboard page (mostly the top one, like the menu). Requests go through the game's own
+HttpWorker, fetchScores() and submitScores(), one try each so errors show up instead of being retried away.
+Prints requests per second and p50/p99/p999 latency per kind, then checks every rank it got back (see RankChecker).
+*/
+
+// The board only grows, so no submit may come back ranked better than an earlier answer ranked an equal or higher
+// score: whatever was above that score then is still above it. Every page read must rank like RANK() does.
+class RankChecker {
+public:
+    struct Floor {
+        int equal = 0;      // an equal score ranked this, mine may not be better
+        int higher = 0;     // a higher score ranked this, mine must be worse
+    };
+
+    // taken when a request is sent: only answers that arrived before may constrain it
+    Floor floorFor(int score) const {
+        Floor floor;
+        auto atLeast = seen.lower_bound(score);
+        if (atLeast != seen.end())
+            floor.equal = atLeast->second;
+        auto above = seen.upper_bound(score);
+        if (above != seen.end())
+            floor.higher = above->second;
+        return floor;
+    }
+
+    // returns false (and counts it) when rank breaks the floor
+    bool check(int rank, const Floor& floor) {
+        bool ok = rank >= 1 && rank >= floor.equal && rank > floor.higher;
+        if (!ok)
+            violations++;
+        return ok;
+    }
+
+    // ties share a rank, a new score ranks by its position; a page can't start ranked worse than its offset
+    bool checkPage(const std::vector<ScoreRecord>& page, int offset) {
+        bool ok = page.empty() || page[0].rank <= offset + 1;
+        for (size_t i = 1; i < page.size() && ok; i++) {
+            if (page[i].score > page[i - 1].score)
+                ok = false;
+            else if (page[i].score == page[i - 1].score)
+                ok = page[i].rank == page[i - 1].rank;
+            else
+                ok = page[i].rank == offset + (int)i + 1;
+        }
+        if (!ok)
+            violations++;
+        return ok;
+    }
+
+    // a score that is stored now with this rank
+    void seenRank(int score, int rank) {
+        // kept as a staircase, scores up and ranks down: a lower score that didn't rank worse says nothing new
+        auto atLeast = seen.lower_bound(score);
+        if (atLeast != seen.end() && atLeast->second >= rank)
+            return;
+        auto at = seen.insert_or_assign(score, rank).first;
+        while (at != seen.begin() && std::prev(at)->second <= rank)
+            seen.erase(std::prev(at));
+    }
+
+    int violations = 0;
+
+private:
+    std::map<int, int> seen;    // score -> worst rank seen for it or any higher score
+};
+
+// whole numbers only, "12x" or "" is no number
+bool parseInt(const std::string& text, int& value) {
+    char* end = nullptr;
+    long parsed = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || parsed < std::numeric_limits<int>::min() || parsed > std::numeric_limits<int>::max())
+        return false;
+    value = (int)parsed;
+    return true;
+}
+
+// args: url [clients] [seconds] [submit percent]
+// exits 0 if all went well, 1 if a request failed (or the args are wrong), 2 if all answered but the ranks disagree
+const int LOADTEST_BAD_RANKS = 2;
+
+int runLoadTest(const std::vector<std::string>& args) {
+    using Clock = std::chrono::steady_clock;
+    const int SCORE_RANGE = 1000;
+    const int DEEP_PAGES = 10;      // a quarter of the reads go up to this many pages down
+
+    int clients = 32;
+    int seconds = 30;
+    int submitPercent = 20;
+    bool valid = !args.empty() && args.size() <= 4
+                 && (args.size() < 2 || (parseInt(args[1], clients) && clients >= 1))
+                 && (args.size() < 3 || (parseInt(args[2], seconds) && seconds >= 1))
+                 && (args.size() < 4 || (parseInt(args[3], submitPercent) && submitPercent >= 0 && submitPercent <= 100));
+    if (!valid) {
+        std::cerr << "Usage: app --loadtest <url of a test scoreAPI> [clients >= 1, 32] [seconds >= 1, 30] [submit percent 0-100, 20]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string& server = args[0];
+
+    // fetchScores() and submitScores() send to scoreServer()
+#ifdef _WIN32
+    _putenv_s("PTJ_SCORE_SERVER", server.c_str());
+#else
+    setenv("PTJ_SCORE_SERVER", server.c_str(), 1);
+#endif
+
+    struct Request {
+        bool submit = false;
+        int offset = 0;
+        ScoreSubmission score;
+        RankChecker::Floor floor;
+        std::shared_ptr<ScoreListParser> parser;
+        std::future<HttpResponse> answer;
+    };
+
+    HttpWorker http(clients);
+    RankChecker ranks;
+    std::mt19937 rng(std::random_device{}());
+    std::vector<double> latencies[2];   // milliseconds, reads and submits
+    int failures[2] = { 0, 0 };
+    int rankErrors = 0;
+
+    auto send = [&](Request& request) {
+        request.submit = (int)(rng() % 100) < submitPercent;
+        request.parser = std::make_shared<ScoreListParser>();
+        if (request.submit) {
+            request.score = { ScoreJournal::newKey(), "loadtest", (int)(rng() % SCORE_RANGE) };
+            request.floor = ranks.floorFor(request.score.score);
+            request.answer = submitScores(http, { request.score }, 10L, 1, request.parser);
+        } else {
+            request.offset = rng() % 4 == 0 ? (int)(rng() % DEEP_PAGES) * LeaderboardView::PAGE_SIZE : 0;
+            request.answer = fetchScores(http, request.parser, request.offset, LeaderboardView::PAGE_SIZE);
+        }
+    };
+
+    // one request per page row or submitted score: rank checks against the floors from before it was sent
+    auto receive = [&](Request& request, const HttpResponse& response) {
+        const std::vector<ScoreRecord>& records = request.parser->records;
+        bool ok = response.result == CURLE_OK && !request.parser->failed
+                  && request.parser->status == (request.submit ? 201 : 200);
+        if (!ok) {
+            failures[request.submit]++;
+            return;
+        }
+        latencies[request.submit].push_back(std::chrono::duration<double, std::milli>(response.elapsed).count());
+        if (request.submit) {
+            if (records.size() != 1 || records[0].key != request.score.key) {
+                failures[1]++;
+            } else if (!ranks.check(records[0].rank, request.floor)) {
+                if (rankErrors++ < 10)
+                    std::cerr << "score " << request.score.score << " ranked " << records[0].rank << ", an earlier answer had it at least "
+                              << std::max(request.floor.equal, request.floor.higher + 1) << std::endl;
+            } else {
+                ranks.seenRank(request.score.score, records[0].rank);
+            }
+        } else if (!ranks.checkPage(records, request.offset)) {
+            if (rankErrors++ < 10)
+                std::cerr << "page at " << request.offset << " doesn't rank like RANK()" << std::endl;
+        } else {
+            for (const ScoreRecord& record : records)
+                ranks.seenRank(record.score, record.rank);
+        }
+    };
+
+    std::cout << clients << " clients against " << server << " for " << seconds << " s, " << submitPercent << "% submits" << std::endl;
+    std::vector<Request> requests(clients);
+    Clock::time_point start = Clock::now();
+    Clock::time_point end = start + std::chrono::seconds(seconds);
+    for (Request& request : requests)
+        send(request);
+
+    int running = clients;
+    while (running > 0) {
+        bool any = false;
+        for (Request& request : requests) {
+            if (!request.answer.valid() || request.answer.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                continue;
+            any = true;
+            receive(request, request.answer.get());
+            if (Clock::now() < end)
+                send(request);
+            else
+                running--;
+        }
+        // latency is measured on the worker thread, this only delays the next request a little
+        if (!any)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout.setf(std::ios::fixed);
+    std::cout.precision(1);
+    const char* kinds[2] = { "read  ", "submit" };
+    for (int kind = 0; kind < 2; kind++) {
+        std::vector<double>& ms = latencies[kind];
+        std::sort(ms.begin(), ms.end());
+        std::cout << kinds[kind] << "  " << ms.size() << " ok, " << failures[kind] << " failed, " << ms.size() / elapsed << " req/s";
+        if (!ms.empty()) {
+            size_t n = ms.size();
+            std::cout << ", p50 " << ms[n / 2] << " / p99 " << ms[n * 99 / 100] << " / p999 " << ms[n * 999 / 1000]
+                      << " / max " << ms[n - 1] << " ms";
+        }
+        std::cout << std::endl;
+    }
+    std::cout << "total   " << (latencies[0].size() + latencies[1].size()) / elapsed << " req/s, "
+              << ranks.violations << " inconsistent ranks" << std::endl;
+    if (failures[0] + failures[1] > 0)
+        return EXIT_FAILURE;
+    return ranks.violations == 0 ? EXIT_SUCCESS : LOADTEST_BAD_RANKS;
 }
 
 // Entry point function
-int main() {
+int main(int argc, char* argv[]) {
+    // tools, these run in the console instead of opening the game
+    if (argc >= 3 && std::string(argv[1]) == "--simulate")
+        return runBatchSimulation(argv[2], argc >= 4 ? argv[3] : "results.csv");
+    if (argc >= 2 && std::string(argv[1]) == "--bench")
+        return runBenchmarks(argc >= 3 ? argv[2] : "bench.json", argc >= 4 ? argv[3] : "");
+    if (argc >= 2 && std::string(argv[1]) == "--loadtest")
+        return runLoadTest(std::vector<std::string>(argv + 2, argv + argc));
+
+#ifdef _WIN32
     FreeConsole();
+#endif
 
     sf::RenderWindow window(sf::VideoMode(1600, 837), "Protect The Jungle: monkeys fight back!");
+    // app.exe --vsync: no tearing, best on 60 Hz monitors (the frame pacer still holds the game at FRAME_RATE)
+    window.setVerticalSyncEnabled(argc >= 2 && std::string(argv[1]) == "--vsync");
 
     sf::Music music;
     music.openFromFile("res/mainMenu.ogg");
 
-    std::vector<sf::Text*> scoreTexts = curlGetScores();
+    // the menu draws right away, the leaderboard fills in when it arrives
+    HttpWorker http;
+    ScoreJournal scoreJournal("scores.journal", http);
+    sf::Font menuFont;
+    menuFont.loadFromFile("res/arial.ttf");
+    LeaderboardView leaderboardView(sf::Vector2f(250.f, 314.f), 350.f, 29, menuFont, http);
+    LeaderboardCache leaderboard("leaderboard.dat");
+    if (leaderboard.load())
+        leaderboardView.setPage(0, leaderboard.records);
+    auto scores = std::make_shared<ScoreListParser>();
+    std::future<HttpResponse> scoresRequest = fetchScores(http, scores, 0, LeaderboardView::PAGE_SIZE, leaderboard.etag, leaderboard.lastModified);
+
+    Autosave autosave("autosave.dat");
+    Profiler profiler;
+    WorkStealingPool lanePool;
+    GameSnapshot savedGame;
+    bool hasSavedGame = autosave.load(savedGame);
 
     // sample menu
     bool gameStartRequested = false;
+    bool continueRequested = false;
     bool exitRequested = false;
     Button startGameButton(sf::Vector2f(650.f, 450.f), sf::Vector2f(300.f, 100.f), "Enter the Jungle", sf::Color(180, 100, 180), [&gameStartRequested, &music]{
         gameStartRequested = true;
@@ -1322,6 +5172,11 @@ int main() {
     Button endGameButton(sf::Vector2f(650.f, 550.f), sf::Vector2f(300.f, 50.f), "Dont enter it", sf::Color(200, 80, 120), [&exitRequested] {
         exitRequested = true;
     });
+    Button continueButton(sf::Vector2f(650.f, 610.f), sf::Vector2f(300.f, 50.f), "Continue", sf::Color(100, 140, 80), [&gameStartRequested, &continueRequested, &music] {
+        gameStartRequested = true;
+        continueRequested = true;
+        music.stop();
+    });
     Button eminemButton(sf::Vector2f(650.f, 100.f), sf::Vector2f(100.f, 100.f), "Eminem Button", sf::Color(0, 80, 120), [&music] {
         music.play();
     }, "res/eminem.jpg");
@@ -1350,6 +5205,9 @@ int main() {
             startGameButton.handleEvent(event, window);
             endGameButton.handleEvent(event, window);
             eminemButton.handleEvent(event, window);
+            if (hasSavedGame)
+                continueButton.handleEvent(event, window);
+            leaderboardView.handleEvent(event, window);
         }
         window.clear();
         window.draw(sprite);
@@ -1358,26 +5216,42 @@ int main() {
         startGameButton.draw(window);
         endGameButton.draw(window);
         eminemButton.draw(window);
-        for (sf::Text* text : scoreTexts)
-            window.draw(*text);
+        if (hasSavedGame)
+            continueButton.draw(window);
+        if (scoresRequest.valid() && scoresRequest.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            HttpResponse response = scoresRequest.get();
+            // 304: the cached rows are already up to date
+            if (response.result == CURLE_OK && scores->status == 200) {
+                leaderboard.store(response, std::move(scores->records));
+                leaderboardView.setPage(0, leaderboard.records);
+            } else if (response.httpStatus != 304) {
+                leaderboardView.setOffline();
+            }
+        }
+        leaderboardView.update();
+        leaderboardView.draw(window);
         window.display();
         sf::sleep(sf::milliseconds(16));
     }
 
     Game* game = new Game(window);
+    game->autosave = &autosave;
+    game->profiler = &profiler;
+    game->pool = &lanePool;
+    if (continueRequested)
+        game->restore(savedGame);
 
-    while (game->gameWindow.isOpen()) {
+    while (game->gameWindow->isOpen()) {
         bool isWon = game->startGame();
         if (isWon) {
             // victory wirds das über haupt gä?!?!?!?! (I <3 GIBB)
         } else {
-            bool isSaved = false;
             sf::Texture texture;
             sf::Sprite sprite;
             texture.loadFromFile("res/bgMenu.png");
             sprite.setTexture(texture);
 
-            sf::Vector2u windowSize = game->gameWindow.getSize();
+            sf::Vector2u windowSize = game->gameWindow->getSize();
             sf::Vector2u spriteSize = texture.getSize();
             double centeredX = (windowSize.x / 2) - (spriteSize.x / 2);
             double centeredY = (windowSize.y / 2) - (spriteSize.y / 2);
@@ -1390,14 +5264,24 @@ int main() {
             });
 
             bool saveScoreRequested = false;
-            Button saveScoreButton(sf::Vector2f(1100.f, 450.f), sf::Vector2f(150.f, 100.f), "Save Score", sf::Color(180, 100, 180), [&saveScoreRequested, &isSaved]{
-                if (!isSaved) {
+            std::string savedKey;   // the score's key in the journal once it is saved
+            Button saveScoreButton(sf::Vector2f(1100.f, 450.f), sf::Vector2f(150.f, 100.f), "Save Score", sf::Color(180, 100, 180), [&saveScoreRequested, &savedKey]{
+                if (savedKey.empty()) {
                     saveScoreRequested = true;
                 }
             });
+            sf::Text saveStatusText = game->generateText(1100, 560);
 
             sf::Text scoreText = game->generateText(250, 350);
             scoreText.setString("Your score: " + std::to_string(game->score));
+            // right away from the cached leaderboard, the server may see it a bit differently
+            sf::Text rankText = game->generateText(250, 385);
+            int provisionalRank = leaderboard.provisionalRank(game->score);
+            // the cache only has the top page, below it we can't tell
+            if (provisionalRank <= (int)leaderboard.records.size() || (!leaderboard.records.empty() && leaderboard.records.size() < LeaderboardView::PAGE_SIZE))
+                rankText.setString("that's about rank " + std::to_string(provisionalRank));
+            else if (!leaderboard.records.empty())
+                rankText.setString("not in the top " + std::to_string(leaderboard.records.size()) + " this time");
             sf::Text playerText = game->generateText(650, 200);
 
             sf::String lastPlayerInput;
@@ -1424,20 +5308,42 @@ int main() {
                 }
 
                 if (saveScoreRequested) {
-                    isSaved = saveScore(playerInput.toAnsiString(), game->score);
+                    std::basic_string<sf::Uint8> name = playerInput.toUtf8();
+                    savedKey = scoreJournal.add(std::string(name.begin(), name.end()), game->score);
                     saveScoreRequested = false;
                 }
+                if (!savedKey.empty()) {
+                    switch (scoreJournal.status(savedKey)) {
+                    case ScoreJournal::SENT:
+                        if (scoreJournal.rank(savedKey) > 0)
+                            saveStatusText.setString("saved! rank " + std::to_string(scoreJournal.rank(savedKey)));
+                        else
+                            saveStatusText.setString("saved!");
+                        break;
+                    case ScoreJournal::OFFLINE:
+                        saveStatusText.setString("no connection, it gets\nsent later");
+                        break;
+                    default:
+                        saveStatusText.setString("saving" + std::string(1 + keyDebounceCounter / 20 % 3, '.'));
+                    }
+                }
 
                 window.draw(sprite);
                 window.draw(scoreText);
+                window.draw(rankText);
                 window.draw(playerText);
                 restartGameButton.draw(window);
                 saveScoreButton.draw(window);
+                window.draw(saveStatusText);
                 window.display();
                 keyDebounceCounter++;
                 sf::sleep(sf::milliseconds(16));
             }
+            delete game;
             game = new Game(window);
+            game->autosave = &autosave;
+            game->profiler = &profiler;
+            game->pool = &lanePool;
         }
     }
 }
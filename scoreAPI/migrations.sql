@@ -0,0 +1,8 @@
+-- Changes to the score table, run them in order on the server's database.
+
+-- idempotency keys from the game's score journal: a score sent twice is stored once
+ALTER TABLE score ADD COLUMN request_key CHAR(16) NULL;
+ALTER TABLE score ADD UNIQUE INDEX score_request_key (request_key);
+
+-- read.php pages through the board best first
+CREATE INDEX score_score ON score (score);
@@ -12,7 +12,12 @@ $requestMethod = $_SERVER["REQUEST_METHOD"];
 if($requestMethod == "POST"){
 
     $inputData = json_decode(file_get_contents("php://input"), true);
-    $storeScore = storeScore($inputData);
+    // the game sends a list (its score journal), a single object still works
+    if (is_array($inputData) && isset($inputData[0])) {
+        $storeScore = storeScores($inputData);
+    } else {
+        $storeScore = storeScore($inputData);
+    }
 
     echo $storeScore;
 } else {
@@ -2,18 +2,36 @@
 
 require '../inc/dbcon.php';
 
-function getAllScores(){
+// One page of the leaderboard, best first. The index on score (see migrations.sql) makes this a short index scan
+// instead of ranking the whole table, so the cost and the answer stay the same size however many scores there are.
+// Ranks work like RANK(): the first row counts the scores above it, the rest follow from their position.
+function getScores($limit, $offset){
 
     global $conn;
-    $query = "SELECT name, score, RANK() OVER (ORDER BY score DESC) AS 'rank' FROM score";
+    $limit = max(1, min(100, (int)$limit));
+    $offset = max(0, (int)$offset);
+    $query = "SELECT name, score FROM score ORDER BY score DESC, id DESC LIMIT $limit OFFSET $offset";
     $query_run = mysqli_query($conn,$query);
 
     if($query_run){
 
-        if(mysqli_num_rows($query_run) >0) {
+        if(mysqli_num_rows($query_run) >0 || $offset > 0) {
 
             $res = mysqli_fetch_all($query_run, MYSQLI_ASSOC);
 
+            if (count($res) > 0) {
+                $first = (int)$res[0]['score'];
+                $above = mysqli_fetch_row(mysqli_query($conn, "SELECT COUNT(*) FROM score WHERE score > $first"));
+                $rank = (int)$above[0] + 1;
+                foreach ($res as $i => &$row) {
+                    if ($i > 0 && (int)$row['score'] != (int)$res[$i - 1]['score']) {
+                        $rank = $offset + $i + 1;
+                    }
+                    $row['rank'] = $rank;
+                }
+                unset($row);
+            }
+
             $data = [
                         'status' => 200,
                         'message' => 'Scores Fetched Successfully',
@@ -60,16 +78,7 @@ function storeScore($score){
     } else {
         $insert = "INSERT INTO score (name, score) VALUES ('$name', $score)";
         $res = mysqli_query($conn, $insert);
-        $id = mysqli_insert_id($conn);
-        $query = "SELECT id, RANK() OVER (ORDER BY score DESC) AS 'rank' FROM score";
-        $query_run = mysqli_query($conn, $query);
-        $ranks = mysqli_fetch_all($query_run);
-
-        foreach ($ranks as $rank){
-            if ($rank[0] == $id) {
-                $resultRank = $rank[1];
-            }
-        }
+        $resultRank = rankOf($score);
 
         if ($res) {
             $data = [
@@ -94,6 +103,60 @@ function storeScore($score){
 
 }
 
+// rank of a stored score like RANK() gives it: 1 + the scores above it,
+// counted on the index on score so it stays quick however big the table gets
+function rankOf($score) {
+    global $conn;
+    $score = (int)$score;
+    $above = mysqli_fetch_row(mysqli_query($conn, "SELECT COUNT(*) FROM score WHERE score > $score"));
+    return (int)$above[0] + 1;
+}
+
+// A list of scores from the game's journal, each with a key (see migrations.sql).
+// A key that is already stored is not inserted again, so the game can safely send a batch twice.
+// Answers 201 once every score is handled; scores that can never be stored (no name) come back with status 422.
+function storeScores($list){
+
+    global $conn;
+
+    $results = [];
+    foreach ($list as $item) {
+        $key = validateInput(isset($item['key']) ? $item['key'] : '');
+        $name = validateInput(isset($item['name']) ? $item['name'] : '');
+        $score = validateInput(isset($item['score']) ? $item['score'] : '');
+
+        if (empty(trim($key)) || empty(trim($name)) || !is_numeric($score)) {
+            $results[] = ['key' => $key, 'status' => 422];
+            continue;
+        }
+
+        $existing = mysqli_query($conn, "SELECT score FROM score WHERE request_key = '$key'");
+        $row = $existing ? mysqli_fetch_row($existing) : null;
+        if ($row) {
+            $score = $row[0];
+        } else {
+            $score = (int)$score;
+            if (!mysqli_query($conn, "INSERT INTO score (name, score, request_key) VALUES ('$name', $score, '$key')")) {
+                $data = [
+                    'status' => 500,
+                    'message' => 'Internal Server Error'
+                ];
+                header("HTTP/1.0. 500 Internal Server Error");
+                return json_encode($data);
+            }
+        }
+        $results[] = ['key' => $key, 'status' => 201, 'rank' => rankOf($score)];
+    }
+
+    $data = [
+        'status' => 201,
+        'message' => 'Scores Created Successfully',
+        'data' => $results
+    ];
+    header("HTTP/1.0. 201 Created");
+    return json_encode($data);
+}
+
 function validateInput($data) {
     global $conn;
     $data = trim($data); // Leerzeichen am Anfang und Ende entfernen
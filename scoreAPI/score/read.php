@@ -10,7 +10,18 @@ header('Access-Control-Allow-Headers: Content-Type, Access-Control-Allow-Headers
 $requestMethod = $_SERVER["REQUEST_METHOD"];
 
 if($requestMethod == "GET"){
-    $scoreList = getAllScores();
+    // ?limit=29&offset=0, at most 100 rows per page
+    $limit = isset($_GET['limit']) ? $_GET['limit'] : 100;
+    $offset = isset($_GET['offset']) ? $_GET['offset'] : 0;
+    $scoreList = getScores($limit, $offset);
+
+    // the game keeps the last board; if it still has this one, a 304 without body is enough
+    $etag = '"' . md5($scoreList) . '"';
+    header('ETag: ' . $etag);
+    if (isset($_SERVER['HTTP_IF_NONE_MATCH']) && trim($_SERVER['HTTP_IF_NONE_MATCH']) == $etag) {
+        http_response_code(304);
+        exit;
+    }
     echo $scoreList;
 } else {
     $data = [
@@ -0,0 +1,127 @@
+// ScoreJournal against the stand-in server (score_server.py): offline queueing, a torn journal, the server coming
+// up mid-session and the batches the flusher sends. Linux only, run it through tests/run.sh 🧪
+#define main app_main
+#include "../main.cpp"
+#undef main
+
+#include <cstdlib>
+#include <iterator>
+
+static int failed = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " << #condition << std::endl; \
+        failed++; \
+    } \
+} while (0)
+
+static const std::string JOURNAL = "journal_test.journal";
+static std::string port = "8790";
+
+static std::string server() {
+    return "http://127.0.0.1:" + port + "/";
+}
+
+static bool waitFor(std::function<bool()> done, int seconds) {
+    auto until = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > until)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    return true;
+}
+
+// the keys of every request create.php got, one list per request
+static std::vector<std::vector<std::string>> batches(HttpWorker& http) {
+    std::vector<std::vector<std::string>> out;
+    std::istringstream lines(http.submit(server() + "_batches", "", {}, 5L, 1).get().body);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream keys(line);
+        out.emplace_back(std::istream_iterator<std::string>(keys), std::istream_iterator<std::string>());
+    }
+    return out;
+}
+
+static void startServer() {
+    CHECK(std::system(("python3 tests/score_server.py " + port + " & echo $! > journal_test.pid").c_str()) == 0);
+    HttpWorker http;
+    CHECK(waitFor([&http] { return http.submit(server() + "_batches", "", {}, 1L, 1).get().httpStatus == 200; }, 10));
+}
+
+static void stopServer() {
+    std::system("kill $(cat journal_test.pid) && rm journal_test.pid");
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+}
+
+// nothing listens yet: the scores wait in the journal, the first try marks them offline
+static std::vector<std::string> testOffline() {
+    std::vector<std::string> keys;
+    HttpWorker http;
+    ScoreJournal journal(JOURNAL, http);
+    for (int i = 0; i < 5; i++)
+        keys.push_back(journal.add("offline", 100 + i));
+    CHECK(waitFor([&] { return journal.status(keys[0]) == ScoreJournal::OFFLINE; }, 10));
+    CHECK(std::filesystem::exists(JOURNAL) && std::filesystem::file_size(JOURNAL) > 0);
+    return keys;
+}
+
+// a crash mid-append: the next session drops the broken last score and sends the rest
+static void testTornTail(const std::vector<std::string>& keys) {
+    std::filesystem::resize_file(JOURNAL, std::filesystem::file_size(JOURNAL) - 3);
+    startServer();
+    {
+        HttpWorker http;
+        ScoreJournal journal(JOURNAL, http);
+        CHECK(waitFor([&] { return !batches(http).empty(); }, 10));
+        CHECK(batches(http) == std::vector<std::vector<std::string>>{ std::vector<std::string>(keys.begin(), keys.end() - 1) });
+        CHECK(waitFor([] { return !std::filesystem::exists(JOURNAL); }, 10));
+    }
+    stopServer();
+}
+
+// offline first, then the server comes up: the backoff finds it, 45 scores go in batches of 20, 20 and 5
+static void testServerComesUp() {
+    HttpWorker http;
+    ScoreJournal journal(JOURNAL, http);
+    std::vector<std::string> keys;
+    for (int i = 0; i < 45; i++)
+        keys.push_back(journal.add("batch", 1000 - i));
+    CHECK(waitFor([&] { return journal.status(keys[0]) == ScoreJournal::OFFLINE; }, 10));
+
+    startServer();
+    bool sent = waitFor([&] {
+        return std::all_of(keys.begin(), keys.end(), [&](const std::string& key) { return journal.status(key) == ScoreJournal::SENT; });
+    }, 60);
+    CHECK(sent);
+    if (sent) {
+        std::vector<std::vector<std::string>> sentBatches = batches(http);
+        CHECK(sentBatches.size() == 3);
+        std::vector<std::string> inOrder;
+        for (const std::vector<std::string>& batch : sentBatches)
+            inOrder.insert(inOrder.end(), batch.begin(), batch.end());
+        CHECK(sentBatches.size() == 3 && sentBatches[0].size() == 20 && sentBatches[1].size() == 20 && sentBatches[2].size() == 5);
+        CHECK(inOrder == keys);
+        // every score is lower than the ones before it
+        for (int i = 0; i < 45; i++)
+            CHECK(journal.rank(keys[i]) == i + 1);
+    }
+    CHECK(waitFor([] { return !std::filesystem::exists(JOURNAL); }, 10));
+    stopServer();
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2)
+        port = argv[1];
+    setenv("PTJ_SCORE_SERVER", server().c_str(), 1);
+    std::filesystem::remove(JOURNAL);
+
+    testTornTail(testOffline());
+    testServerComesUp();
+
+    std::filesystem::remove(JOURNAL);
+    std::cout << (failed == 0 ? "journal_test passed" : "journal_test FAILED") << std::endl;
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
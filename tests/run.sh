@@ -0,0 +1,28 @@
+#!/bin/sh
+# Builds and runs the tests on Linux, needs python3 and the packages build.sh needs
+#   ./tests/run.sh
+# journal_test starts tests/score_server.py itself (port 8790) and stops it again.
+# The load test runs against the stand-in twice (port 8791): it has to pass, then catch the --wrong-ranks server.
+
+cd "$(dirname "$0")/.." || exit 1
+mkdir -p bin
+# the tests include main.cpp with its main() renamed, which then has no return
+g++ -std=c++17 -O2 -Wno-return-type -o bin/journal_test tests/journal_test.cpp -lsfml-graphics -lsfml-window -lsfml-system -lsfml-audio -lcurl -pthread || exit 1
+./bin/journal_test || exit 1
+
+./build.sh --no-run || exit 1
+loadtest() {
+    python3 tests/score_server.py 8791 $1 &
+    server=$!
+    sleep 1
+    ./bin/app --loadtest http://127.0.0.1:8791/ 16 3 30
+    result=$?
+    kill $server
+    wait $server 2>/dev/null
+    return $result
+}
+loadtest || { echo "load test failed against the stand-in"; exit 1; }
+# exit 2: every request answered, the ranks didn't add up
+loadtest --wrong-ranks
+[ $? -eq 2 ] || { echo "load test missed the wrong ranks"; exit 1; }
+echo "tests passed"
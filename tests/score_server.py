@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Stand-in for scoreAPI/score (create.php and read.php) that keeps the board in memory, for the tests 🧪
+#   python3 tests/score_server.py [port 8790] [--wrong-ranks]
+#
+# Answers like function.php: create.php takes a list (the journal) or a single score, stores every key once and
+# ranks like RANK(); read.php?limit=..&offset=.. returns one page, best first.
+# GET /_batches lists what create.php got, one line per request with the keys in it (for journal_test.cpp).
+# --wrong-ranks answers every 10th new score with rank 1 whatever it is, the load test has to catch that.
+
+import bisect
+import http.server
+import json
+import sys
+import threading
+import urllib.parse
+
+lock = threading.Lock()
+board = []         # (-score, -id), so the list sorts best first like ORDER BY score DESC, id DESC
+scores = {}        # request_key -> score
+batches = []       # keys of every create.php request
+wrong_ranks = False
+
+
+def rank_of(score):
+    # 1 + the scores above it
+    return bisect.bisect_left(board, (-score, -len(board) - 1)) + 1
+
+
+def store(item):
+    key = str(item.get('key', '')).strip()
+    name = str(item.get('name', '')).strip()
+    try:
+        score = int(item.get('score', ''))
+    except ValueError:
+        return {'key': key, 'status': 422}
+    if not key or not name:
+        return {'key': key, 'status': 422}
+    if key not in scores:
+        scores[key] = score
+        bisect.insort(board, (-score, -len(scores)))
+        if wrong_ranks and len(scores) % 10 == 0:
+            return {'key': key, 'status': 201, 'rank': 1}
+    return {'key': key, 'status': 201, 'rank': rank_of(scores[key])}
+
+
+def page(limit, offset):
+    rows = []
+    for i, (negative, _) in enumerate(board[offset:offset + limit]):
+        score = -negative
+        if i == 0:
+            rank = rank_of(score)
+        elif score != rows[-1]['score']:
+            rank = offset + i + 1
+        else:
+            rank = rows[-1]['rank']
+        rows.append({'name': 'player', 'score': score, 'rank': rank})
+    return rows
+
+
+class Server(http.server.ThreadingHTTPServer):
+    daemon_threads = True
+    request_queue_size = 128    # the load test opens many connections at once
+
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def answer(self, status, body, content_type='application/json'):
+        data = body.encode()
+        self.send_response(status)
+        self.send_header('Content-Type', content_type)
+        self.send_header('Content-Length', str(len(data)))
+        self.end_headers()
+        self.wfile.write(data)
+
+    def do_GET(self):
+        url = urllib.parse.urlparse(self.path)
+        query = urllib.parse.parse_qs(url.query)
+        if url.path.endswith('/_batches'):
+            with lock:
+                self.answer(200, ''.join(' '.join(keys) + '\n' for keys in batches), 'text/plain')
+        elif url.path.endswith('/read.php'):
+            limit = max(1, min(100, int(query.get('limit', ['100'])[0])))
+            offset = max(0, int(query.get('offset', ['0'])[0]))
+            with lock:
+                rows = page(limit, offset)
+            self.answer(200, json.dumps({'status': 200, 'message': 'Scores Fetched Successfully', 'data': rows}))
+        else:
+            self.answer(404, json.dumps({'status': 404, 'message': 'Not Found'}))
+
+    def do_POST(self):
+        if not urllib.parse.urlparse(self.path).path.endswith('/create.php'):
+            self.answer(404, json.dumps({'status': 404, 'message': 'Not Found'}))
+            return
+        try:
+            data = json.loads(self.rfile.read(int(self.headers.get('Content-Length', 0))))
+        except ValueError:
+            self.answer(422, json.dumps({'status': 422, 'message': 'Invalid JSON'}))
+            return
+        with lock:
+            if isinstance(data, list):
+                batches.append([str(item.get('key', '')) for item in data])
+                results = [store(item) for item in data]
+                body = {'status': 201, 'message': 'Scores Created Successfully', 'data': results}
+            else:
+                batches.append([])
+                result = store(dict(data, key=data.get('key') or 'single-%d' % len(batches)))
+                body = {'status': result['status'], 'message': 'Score Created Successfully', 'data': {'rank': result.get('rank', 0)}}
+        self.answer(body['status'], json.dumps(body))
+
+    def log_message(self, *args):
+        pass
+
+
+if __name__ == '__main__':
+    args = [arg for arg in sys.argv[1:] if arg != '--wrong-ranks']
+    wrong_ranks = len(args) < len(sys.argv) - 1
+    port = int(args[0]) if args else 8790
+    Server(('127.0.0.1', port), Handler).serve_forever()